@@ -1,141 +1,232 @@
-#include "boundingbox.h"
-
-//======================== BoundingBox implementation ==============================================
-BoundingBox::BoundingBox() {
-}
-
-BoundingBox::BoundingBox(vector<int> thatLow, vector<int> thatHigh) {
-	if (thatHigh.size() != thatLow.size())
-	{
-		cerr << "lowest and highest point of rectangle should have the same length\n";
-		//exit(-1);
-	}
-
-	this->lowest = thatLow;
-	this->highest = thatHigh;
-	this->is_valid();
-}
-
-BoundingBox::BoundingBox(const BoundingBox& thatBox) {
-	this->lowest = thatBox.lowest;
-	this->highest = thatBox.highest;
-}
-
-const vector<int>& BoundingBox::get_lowest() const {
-	return this->lowest;
-}
-
-const vector<int>& BoundingBox::get_highest() const {
-	return this->highest;
-}
-
-int BoundingBox::get_dim() const {
-	return this->lowest.size();
-}
-
-int BoundingBox::get_area() const {
-	int area = 1;
-
-	for (int cIndex = 0; cIndex < this->get_dim(); cIndex++)
-	{
-		area *= this->highest[cIndex] - this->lowest[cIndex];
-	}
-
-	return area;
-}
-
-int BoundingBox::get_lowestValue_at(const int index) const {
-	return this->lowest[index];
-}
-
-int BoundingBox::get_highestValue_at(const int index) const {
-	return this->highest[index];
-}
-
-//if two bounding boxes are the same with respect to their coordinates
-bool BoundingBox::is_equal(const BoundingBox& rhs) const {
-	if (this->lowest == rhs.get_lowest() && this->highest == rhs.get_highest())
-	{
-		return true;
-	}
-	return false;
-}
-
-bool BoundingBox::is_intersected(const BoundingBox& rhs) const { 
-	
-	if (this->get_dim() != rhs.get_dim())
-	{
-		cerr << "domensiomality inconsistency" << endl;
-		//exit(-1);
+#include "boundingbox.h"
+
+//======================== BoundingBox implementation ==============================================
+template <int D>
+BoundingBox<D>::BoundingBox() {
+}
+
+template <int D>
+BoundingBox<D>::BoundingBox(const vector<int>& thatLow, const vector<int>& thatHigh) {
+	if (thatHigh.size() != thatLow.size())
+	{
+		cerr << "lowest and highest point of rectangle should have the same length\n";
+		//exit(-1);
+	}
+	if (D != DYNAMIC_DIM && (int)thatLow.size() != D)
+	{
+		cerr << "domensiomality inconsistency" << endl;
+		//exit(-1);
 	}
 
-	const vector<int>& thatLow = rhs.get_lowest();
-	const vector<int>& thatHigh = rhs.get_highest();
+	int dim = D != DYNAMIC_DIM ? D : thatLow.size();
+	this->coords.resize(dim);
+	for (int cIndex = 0; cIndex < dim; cIndex++)
+	{
+		this->coords.data()[cIndex] = cIndex < (int)thatLow.size() ? thatLow[cIndex] : 0;
+		this->coords.data()[dim + cIndex] = cIndex < (int)thatHigh.size() ? thatHigh[cIndex] : 0;
+	}
+	this->is_valid();
+}
+
+template <int D>
+BoundingBox<D>::BoundingBox(const int* thatLow, const int* thatHigh, int dim) {
+	this->coords.resize(dim);
+	memcpy(this->coords.data(), thatLow, sizeof(int) * this->get_dim());
+	memcpy(this->coords.data() + this->get_dim(), thatHigh, sizeof(int) * this->get_dim());
+}
+
+template <int D>
+const int* BoundingBox<D>::get_lowest() const {
+	return this->coords.data();
+}
+
+template <int D>
+const int* BoundingBox<D>::get_highest() const {
+	return this->coords.data() + this->get_dim();
+}
+
+template <int D>
+int BoundingBox<D>::get_dim() const {
+	return this->coords.dim();
+}
+
+template <int D>
+int BoundingBox<D>::get_area() const {
+	int area = 1;
+	const int* lowest = this->get_lowest();
+	const int* highest = this->get_highest();
+
+	for (int cIndex = 0; cIndex < this->get_dim(); cIndex++)
+	{
+		area *= highest[cIndex] - lowest[cIndex];
+	}
+
+	return area;
+}
+
+template <int D>
+int BoundingBox<D>::get_lowestValue_at(const int index) const {
+	return this->get_lowest()[index];
+}
+
+template <int D>
+int BoundingBox<D>::get_highestValue_at(const int index) const {
+	return this->get_highest()[index];
+}
+
+//squared euclidean distance from ``point'' to this box, 0 if the point is inside.
+template <int D>
+double BoundingBox<D>::get_mindist(const int* point) const {
+	const int* lowest = this->get_lowest();
+	const int* highest = this->get_highest();
+	double dist = 0;
+
+	for (int cIndex = 0; cIndex < this->get_dim(); cIndex++)
+	{
+		double diff = 0;
+		if (point[cIndex] < lowest[cIndex])
+			diff = (double)lowest[cIndex] - point[cIndex];
+		else if (point[cIndex] > highest[cIndex])
+			diff = (double)point[cIndex] - highest[cIndex];
+		dist += diff * diff;
+	}
+
+	return dist;
+}
+
+template <int D>
+double BoundingBox<D>::get_margin() const {
+	double margin = 0;
+
+	for (int cIndex = 0; cIndex < this->get_dim(); cIndex++)
+	{
+		margin += (double)this->get_highest()[cIndex] - this->get_lowest()[cIndex];
+	}
+
+	return margin;
+}
+
+//area shared by this box and ``rhs'', 0 if they do not intersect.
+template <int D>
+double BoundingBox<D>::get_overlap(const BoundingBox& rhs) const {
+	const int* lowest = this->get_lowest();
+	const int* highest = this->get_highest();
+	const int* thatLow = rhs.get_lowest();
+	const int* thatHigh = rhs.get_highest();
+	double overlap = 1;
+
+	for (int cIndex = 0; cIndex < this->get_dim(); cIndex++)
+	{
+		int low = lowest[cIndex] >= thatLow[cIndex] ? lowest[cIndex] : thatLow[cIndex];
+		int high = highest[cIndex] <= thatHigh[cIndex] ? highest[cIndex] : thatHigh[cIndex];
+		if (low > high)
+			return 0;
+		overlap *= (double)high - low;
+	}
+
+	return overlap;
+}
+
+//if two bounding boxes are the same with respect to their coordinates
+template <int D>
+bool BoundingBox<D>::is_equal(const BoundingBox& rhs) const {
+	if (this->get_dim() == rhs.get_dim()
+		&& memcmp(this->coords.data(), rhs.coords.data(), sizeof(int) * 2 * this->get_dim()) == 0)
+	{
+		return true;
+	}
+	return false;
+}
+
+template <int D>
+bool BoundingBox<D>::is_intersected(const BoundingBox& rhs) const {
+
+	if (D == DYNAMIC_DIM && this->get_dim() != rhs.get_dim())
+	{
+		cerr << "domensiomality inconsistency" << endl;
+		//exit(-1);
+	}
+
+	const int* lowest = this->get_lowest();
+	const int* highest = this->get_highest();
+	const int* thatLow = rhs.get_lowest();
+	const int* thatHigh = rhs.get_highest();
 
 	//if the two shapes intersect, they must intersect in all dimensions.
-	for (int cIndex = 0; cIndex < this->get_dim(); cIndex++)
-	{
-		if (this->lowest[cIndex] > thatHigh[cIndex] || this->highest[cIndex] < thatLow[cIndex]) return false;
-	}
+	for (int cIndex = 0; cIndex < this->get_dim(); cIndex++)
+	{
+		if (lowest[cIndex] > thatHigh[cIndex] || highest[cIndex] < thatLow[cIndex]) return false;
+	}
 	return true;
 }
 
-bool BoundingBox::is_valid() const {
-	for (int i = 0; i < this->get_dim(); i++)
-	{
-		if (this->lowest[i] > this->highest[i])
-		{
-			cerr << "bounding box has low value " << this->lowest[i] << " larger than high" << this->highest[i] <<" at dimension " << i << ", which should not\n";
-			//exit(-1);
-			return false;
-		}
+template <int D>
+bool BoundingBox<D>::is_valid() const {
+	const int* lowest = this->get_lowest();
+	const int* highest = this->get_highest();
+
+	for (int i = 0; i < this->get_dim(); i++)
+	{
+		if (lowest[i] > highest[i])
+		{
+			cerr << "bounding box has low value " << lowest[i] << " larger than high" << highest[i] <<" at dimension " << i << ", which should not\n";
+			//exit(-1);
+			return false;
+		}
 	}
 	return true;
 }
 
-void BoundingBox::print() const {
+template <int D>
+void BoundingBox<D>::print() const {
 	cout << "bounding box (";
-	for (int i = 0; i < this->get_dim(); i++)
-	{
-		cout << this->lowest[i];
-		if (i != this->get_dim() - 1)
-		{
-			cout << " ";
-		}
+	for (int i = 0; i < this->get_dim(); i++)
+	{
+		cout << this->get_lowest()[i];
+		if (i != this->get_dim() - 1)
+		{
+			cout << " ";
+		}
 	}
 	cout << ",";
-	for (int i = 0; i < this->get_dim(); i++)
-	{
-		cout << this->highest[i];
-		if (i != this->get_dim() - 1)
-		{
-			cout << " ";
-		}
+	for (int i = 0; i < this->get_dim(); i++)
+	{
+		cout << this->get_highest()[i];
+		if (i != this->get_dim() - 1)
+		{
+			cout << " ";
+		}
 	}
 	cout << ")\n";
 }
 
-
-void BoundingBox::group_with(const BoundingBox& rhs) {
-	if (this->get_dim() != rhs.get_dim()) {
-		cerr << "domensiomality inconsistency" << endl;
-		//exit(-1);
-	};
-
-	const vector<int>& thatLow = rhs.get_lowest();
-	const vector<int>& thatHigh = rhs.get_highest();
-
-	for (int cIndex = 0; cIndex < this->get_dim(); cIndex++)
-	{
-		this->lowest[cIndex] = this->lowest[cIndex] <= thatLow[cIndex] ? this->lowest[cIndex] : thatLow[cIndex];
-		this->highest[cIndex] = this->highest[cIndex] >= thatHigh[cIndex] ? this->highest[cIndex] : thatHigh[cIndex];
-	}
-}
-
-void BoundingBox::set_boundingbox(const BoundingBox& rhs) {
-
-	this->lowest = rhs.get_lowest();
-	this->highest = rhs.get_highest();
-}
-
- 
\ No newline at end of file
+
+template <int D>
+void BoundingBox<D>::group_with(const BoundingBox& rhs) {
+	if (D == DYNAMIC_DIM && this->get_dim() != rhs.get_dim()) {
+		cerr << "domensiomality inconsistency" << endl;
+		//exit(-1);
+	};
+
+	int* lowest = this->coords.data();
+	int* highest = lowest + this->get_dim();
+	const int* thatLow = rhs.get_lowest();
+	const int* thatHigh = rhs.get_highest();
+
+	for (int cIndex = 0; cIndex < this->get_dim(); cIndex++)
+	{
+		lowest[cIndex] = lowest[cIndex] <= thatLow[cIndex] ? lowest[cIndex] : thatLow[cIndex];
+		highest[cIndex] = highest[cIndex] >= thatHigh[cIndex] ? highest[cIndex] : thatHigh[cIndex];
+	}
+}
+
+template <int D>
+void BoundingBox<D>::set_boundingbox(const BoundingBox& rhs) {
+
+	this->coords = rhs.coords;
+}
+
+
+template class BoundingBox<2>;
+template class BoundingBox<3>;
+template class BoundingBox<DYNAMIC_DIM>;
@@ -1,26 +1,61 @@
+#ifndef BOUNDINGBOX_H
+#define BOUNDINGBOX_H
 
-#include <cstring>
+#include <cstring>
 #include <iostream>
 #include <vector>
 
-using namespace std;
+using namespace std;
 
-
+// Template argument selecting a dimension chosen at runtime.
+const int DYNAMIC_DIM = 0;
+
+//coordinates of a bounding box, the lowest corner followed by the highest corner.
+//a fixed dimension keeps them inside the box itself, so no heap allocation is needed.
+template <int D>
+class BoxCoords {
+private:
+	int coords[2 * D];
+public:
+	BoxCoords() { memset(coords, 0, sizeof(coords)); }
+
+	void resize(int) {}
+	int dim() const { return D; }
+	int* data() { return coords; }
+	const int* data() const { return coords; }
+};
+
+//fallback for other dimensionalities: both corners share one heap block.
+template <>
+class BoxCoords<DYNAMIC_DIM> {
+private:
+	vector<int> coords;
+public:
+	void resize(int dim) { coords.resize(2 * dim); }
+	int dim() const { return coords.size() / 2; }
+	int* data() { return coords.empty() ? NULL : &coords[0]; }
+	const int* data() const { return coords.empty() ? NULL : &coords[0]; }
+};
+
+
+template <int D>
 class BoundingBox {
 private:
-	vector<int> lowest; //lowest coordinate of the bounding box
-	vector<int> highest; //highest coordinate
+	BoxCoords<D> coords; //lowest coordinate of the bounding box, then the highest coordinate
 public:
 	BoundingBox();
-	BoundingBox(vector<int> thatLow, vector<int> thatHigh);
-	BoundingBox(const BoundingBox& thatBox);
+	BoundingBox(const vector<int>& thatLow, const vector<int>& thatHigh);
+	BoundingBox(const int* thatLow, const int* thatHigh, int dim);
 
-	const vector<int>& get_lowest() const;
-	const vector<int>& get_highest() const;
+	const int* get_lowest() const;
+	const int* get_highest() const;
 	int get_dim() const;
 	int get_area() const;
 	int get_lowestValue_at(const int index) const;
 	int get_highestValue_at(const int index) const;
+	double get_mindist(const int* point) const; // squared distance from point to the nearest point of this mbr
+	double get_margin() const; // sum of the edge lengths
+	double get_overlap(const BoundingBox& rhs) const; // area of the intersection of this mbr and rhs
 
 	bool is_equal(const BoundingBox& rhs) const; // if this mbr equals to rhs mbr
 	bool is_intersected(const BoundingBox& rhs) const;// if this mbr overlaps with rhs mbr
@@ -31,3 +66,4 @@ public:
 	void set_boundingbox(const BoundingBox& rhs);
 };
 
+#endif
@@ -0,0 +1,189 @@
+#include "concurrent.h"
+
+//======================== ConcurrentRTree implementation ==========================================
+
+template <int D>
+ConcurrentRTree<D>::ConcurrentRTree(int entry_num, int dim)
+	: tree(entry_num, dim)
+{
+}
+
+template <int D>
+ConcurrentRTree<D>::ConcurrentRTree(int entry_num, int dim, InsertMode mode, SplitMethod split)
+	: tree(entry_num, dim, mode, split)
+{
+}
+
+//
+// Wait while a writer is queued, so that readers arriving after it go after it.
+//
+template <int D>
+void ConcurrentRTree<D>::pass_turnstile() const
+{
+	lock_guard<mutex> turn(turnstile);
+}
+
+template <int D>
+void ConcurrentRTree<D>::query_range(const BoundingBox<D>& mbr, int& result_count, int& node_travelled) const
+{
+	pass_turnstile();
+	shared_lock<shared_mutex> guard(lock);
+	tree.query_range(mbr, result_count, node_travelled);
+}
+
+template <int D>
+void ConcurrentRTree<D>::query_range(const BoundingBox<D>& mbr, vector<Entry<D> >& results, int& node_travelled) const
+{
+	pass_turnstile();
+	shared_lock<shared_mutex> guard(lock);
+	tree.query_range(mbr, results, node_travelled);
+}
+
+template <int D>
+bool ConcurrentRTree<D>::query_range(const BoundingBox<D>& mbr, EntryVisitor<D>& visitor, int& node_travelled) const
+{
+	pass_turnstile();
+	shared_lock<shared_mutex> guard(lock);
+	return tree.query_range(mbr, visitor, node_travelled);
+}
+
+template <int D>
+bool ConcurrentRTree<D>::query_point(const vector<int>& coordinate, Entry<D>& result) const
+{
+	pass_turnstile();
+	shared_lock<shared_mutex> guard(lock);
+	return tree.query_point(coordinate, result);
+}
+
+template <int D>
+void ConcurrentRTree<D>::query_knn(const vector<int>& coordinate, int k, vector<Entry<D> >& results, int& node_travelled) const
+{
+	pass_turnstile();
+	shared_lock<shared_mutex> guard(lock);
+	tree.query_knn(coordinate, k, results, node_travelled);
+}
+
+template <int D>
+bool ConcurrentRTree<D>::insert(const vector<int>& coordinate, int rid)
+{
+	lock_guard<mutex> turn(turnstile);
+	unique_lock<shared_mutex> guard(lock);
+	return tree.insert(coordinate, rid);
+}
+
+template <int D>
+bool ConcurrentRTree<D>::upsert(const vector<int>& coordinate, int rid)
+{
+	lock_guard<mutex> turn(turnstile);
+	unique_lock<shared_mutex> guard(lock);
+	return tree.upsert(coordinate, rid);
+}
+
+template <int D>
+int ConcurrentRTree<D>::insert_batch(const vector<Entry<D> >& records)
+{
+	lock_guard<mutex> turn(turnstile);
+	unique_lock<shared_mutex> guard(lock);
+	return tree.insert_batch(records);
+}
+
+template <int D>
+bool ConcurrentRTree<D>::del(const vector<int>& coordinate)
+{
+	lock_guard<mutex> turn(turnstile);
+	unique_lock<shared_mutex> guard(lock);
+	return tree.del(coordinate);
+}
+
+template <int D>
+bool ConcurrentRTree<D>::del(const vector<int>& coordinate, int rid)
+{
+	lock_guard<mutex> turn(turnstile);
+	unique_lock<shared_mutex> guard(lock);
+	return tree.del(coordinate, rid);
+}
+
+template <int D>
+bool ConcurrentRTree<D>::del_rid(int rid)
+{
+	lock_guard<mutex> turn(turnstile);
+	unique_lock<shared_mutex> guard(lock);
+	return tree.del_rid(rid);
+}
+
+template <int D>
+int ConcurrentRTree<D>::delete_batch(const vector<vector<int> >& keys)
+{
+	lock_guard<mutex> turn(turnstile);
+	unique_lock<shared_mutex> guard(lock);
+	return tree.delete_batch(keys);
+}
+
+template <int D>
+bool ConcurrentRTree<D>::update(int rid, const vector<int>& old_coord, const vector<int>& new_coord)
+{
+	lock_guard<mutex> turn(turnstile);
+	unique_lock<shared_mutex> guard(lock);
+	return tree.update(rid, old_coord, new_coord);
+}
+
+template <int D>
+int ConcurrentRTree<D>::bulk_load(const vector<Entry<D> >& records, BulkLoadMethod method, int thread_num)
+{
+	lock_guard<mutex> turn(turnstile);
+	unique_lock<shared_mutex> guard(lock);
+	return tree.bulk_load(records, method, thread_num);
+}
+
+template <int D>
+void ConcurrentRTree<D>::set_locator(bool enabled)
+{
+	lock_guard<mutex> turn(turnstile);
+	unique_lock<shared_mutex> guard(lock);
+	tree.set_locator(enabled);
+}
+
+template <int D>
+void ConcurrentRTree<D>::set_buffer_size(int size)
+{
+	lock_guard<mutex> turn(turnstile);
+	unique_lock<shared_mutex> guard(lock);
+	tree.set_buffer_size(size);
+}
+
+template <int D>
+void ConcurrentRTree<D>::flush()
+{
+	lock_guard<mutex> turn(turnstile);
+	unique_lock<shared_mutex> guard(lock);
+	tree.flush();
+}
+
+template <int D>
+void ConcurrentRTree<D>::set_lazy_delete(bool enabled, double ratio)
+{
+	lock_guard<mutex> turn(turnstile);
+	unique_lock<shared_mutex> guard(lock);
+	tree.set_lazy_delete(enabled, ratio);
+}
+
+template <int D>
+int ConcurrentRTree<D>::compact()
+{
+	lock_guard<mutex> turn(turnstile);
+	unique_lock<shared_mutex> guard(lock);
+	return tree.compact();
+}
+
+template <int D>
+void ConcurrentRTree<D>::stat()
+{
+	lock_guard<mutex> turn(turnstile);
+	unique_lock<shared_mutex> guard(lock);
+	tree.stat();
+}
+
+
+template class ConcurrentRTree<2>;
+template class ConcurrentRTree<3>;
+template class ConcurrentRTree<DYNAMIC_DIM>;
@@ -0,0 +1,53 @@
+#ifndef CONCURRENT_H
+#define CONCURRENT_H
+
+#include <mutex>
+#include <shared_mutex>
+#include "rtree.h"
+
+//
+// R-tree shared by threads behind a readers-writer lock: any number of queries
+// run at once, while an update waits for them to finish and runs alone.
+// A waiting update holds back new queries, so a steady stream of them cannot starve it.
+// A visitor is called with the read lock held, so it must not update the tree.
+//
+template <int D>
+class ConcurrentRTree {
+	public:
+		ConcurrentRTree(int entry_num, int dim);
+		ConcurrentRTree(int entry_num, int dim, InsertMode mode, SplitMethod split);
+
+		// readers
+		void query_range(const BoundingBox<D>& mbr, int& result_count, int& node_travelled) const;
+		void query_range(const BoundingBox<D>& mbr, vector<Entry<D> >& results, int& node_travelled) const;
+		bool query_range(const BoundingBox<D>& mbr, EntryVisitor<D>& visitor, int& node_travelled) const;
+		bool query_point(const vector<int>& coordinate, Entry<D>& result) const;
+		void query_knn(const vector<int>& coordinate, int k, vector<Entry<D> >& results, int& node_travelled) const;
+
+		// writers
+		bool insert(const vector<int>& coordinate, int rid);
+		bool upsert(const vector<int>& coordinate, int rid);
+		int insert_batch(const vector<Entry<D> >& records);
+		bool del(const vector<int>& coordinate);
+		bool del(const vector<int>& coordinate, int rid);
+		bool del_rid(int rid);
+		int delete_batch(const vector<vector<int> >& keys);
+		bool update(int rid, const vector<int>& old_coord, const vector<int>& new_coord);
+		int bulk_load(const vector<Entry<D> >& records, BulkLoadMethod method, int thread_num);
+		void set_locator(bool enabled);
+		void set_buffer_size(int size);
+		void flush();
+		void set_lazy_delete(bool enabled, double ratio);
+		int compact();
+		void stat();
+
+	private:
+		void pass_turnstile() const;
+
+	private:
+		RTree<D> tree;
+		mutable shared_mutex lock;
+		mutable mutex turnstile;	// held by a writer from before it waits for the lock
+};
+
+#endif
@@ -0,0 +1,49 @@
+#include "epoch.h"
+
+//======================== EpochManager implementation =============================================
+
+EpochManager::EpochManager()
+{
+	epoch.store(0);
+	for (int i = 0; i < 3; i++)
+		active[i].store(0);
+}
+
+//
+// Count the reader in the current epoch. If the epoch moved on while it did,
+// it counted itself in a stale epoch: start over in the new one.
+//
+int EpochManager::enter()
+{
+	while (true) {
+		unsigned long long e = epoch.load();
+		int slot = e % 3;
+		active[slot].fetch_add(1);
+		if (epoch.load() == e)
+			return slot;
+		active[slot].fetch_sub(1);
+	}
+}
+
+void EpochManager::leave(int slot)
+{
+	active[slot].fetch_sub(1);
+}
+
+unsigned long long EpochManager::get_epoch() const
+{
+	return epoch.load();
+}
+
+//
+// The readers of epoch e - 2 left before the epoch became e, so the readers in
+// epoch e - 1 are the only ones that hold the move to e + 1 back.
+//
+bool EpochManager::try_advance()
+{
+	unsigned long long e = epoch.load();
+	if (active[(e + 2) % 3].load() != 0)
+		return false;
+	epoch.store(e + 1);
+	return true;
+}
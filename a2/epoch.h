@@ -0,0 +1,32 @@
+#ifndef EPOCH_H
+#define EPOCH_H
+
+#include <atomic>
+
+using namespace std;
+
+//
+// Epoch-based reclamation for one writer and any number of readers. A reader pins
+// the global epoch while it holds pointers into shared data; the writer keeps what it
+// unlinks in epoch e until the epoch has moved to e + 3. The epoch moves on only when
+// no reader is left two epochs behind it, so nothing is freed under a reader, and
+// readers never wait: a slow reader holds back the reclamation, not the writer.
+//
+class EpochManager {
+	public:
+		EpochManager();
+
+		// readers
+		int enter();			// pin the current epoch, and return the slot to pass to leave()
+		void leave(int slot);
+
+		// the writer
+		unsigned long long get_epoch() const;
+		bool try_advance();		// move to the next epoch, unless a reader is still in the previous one
+
+	private:
+		atomic<unsigned long long> epoch;
+		atomic<int> active[3];	// readers in each epoch, by epoch % 3
+};
+
+#endif
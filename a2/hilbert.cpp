@@ -0,0 +1,59 @@
+#include "hilbert.h"
+
+const int MAX_HILBERT_DIM = 64;
+
+//
+// Convert the axes ``x'' of a point on a ``bits''-bit grid to the transposed form of its
+// Hilbert index (J. Skilling, "Programming the Hilbert curve", 2004).
+//
+static void axes_to_transpose(unsigned int* x, int bits, int dim)
+{
+	unsigned int m = 1u << (bits - 1);
+	// inverse undo
+	for (unsigned int q = m; q > 1; q >>= 1) {
+		unsigned int p = q - 1;
+		for (int i = 0; i < dim; i++) {
+			if (x[i] & q) {
+				x[0] ^= p; // invert
+			}
+			else { // exchange
+				unsigned int t = (x[0] ^ x[i]) & p;
+				x[0] ^= t;
+				x[i] ^= t;
+			}
+		}
+	}
+	// gray encode
+	for (int i = 1; i < dim; i++)
+		x[i] ^= x[i - 1];
+	unsigned int t = 0;
+	for (unsigned int q = m; q > 1; q >>= 1) {
+		if (x[dim - 1] & q)
+			t ^= q - 1;
+	}
+	for (int i = 0; i < dim; i++)
+		x[i] ^= t;
+}
+
+unsigned long long hilbert_key(const int* point, const int* lowest, const int* highest, int dim)
+{
+	if (dim > MAX_HILBERT_DIM)
+		dim = MAX_HILBERT_DIM;
+	int bits = 64 / dim < 31 ? 64 / dim : 31;
+	unsigned int grid_max = (1u << bits) - 1;
+
+	unsigned int x[MAX_HILBERT_DIM];
+	for (int i = 0; i < dim; i++) {
+		double range = (double)highest[i] - lowest[i];
+		x[i] = range <= 0 ? 0 : (unsigned int)(((double)point[i] - lowest[i]) / range * grid_max);
+	}
+	axes_to_transpose(x, bits, dim);
+
+	// interleave the transposed bits, most significant first.
+	unsigned long long key = 0;
+	for (int b = bits - 1; b >= 0; b--) {
+		for (int i = 0; i < dim; i++)
+			key = (key << 1) | ((x[i] >> b) & 1);
+	}
+	return key;
+}
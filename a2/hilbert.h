@@ -0,0 +1,11 @@
+#ifndef HILBERT_H
+#define HILBERT_H
+
+//
+// Position of ``point'' along a Hilbert curve filling the box [lowest, highest].
+// Each coordinate is scaled to 64 / dim bits (at most 31), so the key fits in 64 bits;
+// dimensions after the 64th are ignored.
+//
+unsigned long long hilbert_key(const int* point, const int* lowest, const int* highest, int dim);
+
+#endif
@@ -1,283 +1,1236 @@
-#include <cstdlib>
-#include <fstream>
-#include "rtree.h"
-
-using namespace std;
-
-const int MAX_CMD_LEN = 256;
-const int DOMAIN_SIZE = 10000;
-
-void help()
-{
-	cout << "============================================================================\n";
-	cout << "Commands:\n";
-	cout << "============================================================================\n";
-	cout << "i x1(int) x2(int) ... xd(int) rid(int) : insert a record with d-dimension key (x1, x2,... , xd) and record id rid\n";
-	cout << "d x1(int) x2(int) ... xd(int) : delete the record with key (x1, x2,... , xd)\n";
-	cout << "ri s(int) num(int) : random insertions of num records with seed s\n";
-	cout << "rd s(int) num(int) : random deletions of num records with seed s\n";
-	cout << "qp x1(int) x2(int) ... xd(int) : query the record with key (x1, x2, ... , xd)\n";
-	cout << "qr x1min(int) x1max(int) x2min(int) x2max(int) ... xdmin(int) xdmax(int) : find records inside range\n";
-	cout << "     where ximin<=xi<=ximax\n";
-	cout << "s : print the statistic information of the tree\n";
-	cout << "p : print the tree\n";
-	cout << "h : show this help menu\n";
-	cout << "x : exit\n";
-	cout << "============================================================================\n";
-}
-
-void error(const char* cmd)
-{
-	cerr << "Error: " << cmd << endl;
-}
-
-bool process(char* cmd, RTree& tree, int dimension)
-{
-	
-	const int MAX_ARG_NUM = 256; // limit to at most 256 arguments
-	char* args[MAX_ARG_NUM];
-	
-	char msg[1024]; // error message.
-	int actualMaxArgNum = 1 + dimension * 2;
-	if (actualMaxArgNum > MAX_ARG_NUM)
-	{
-		sprintf(msg, "Too many command arguments");
-		error(msg);
-		return true;
-	}
-	int num_arg = 0;
-	char* token = strtok(cmd, "\n \t");
-	for (; token != NULL && num_arg < actualMaxArgNum; num_arg++) {
-		args[num_arg] = token;
-		token = strtok(NULL, " \t");
-	}
-	if (num_arg == 0 || token != NULL) {
-		sprintf(msg, "Wrong number of command arguments");
-		error(msg);
-		return true;
-	}
-	if (strcmp(args[0], "i") == 0) { // insertion.
-		if (num_arg != dimension + 2) {
-			sprintf(msg, "Wrong number of arguments for command 'i'");
-			error(msg);
-		}
-		else {
-			//insert a point, modelled by a bounding box
-			vector<int> coordinate;
-			for (int i = 0; i < dimension; i++)
-			{
-				int coord = atoi(args[i + 1]);
-				coordinate.push_back(coord);
-			}
-			int rid = atoi(args[dimension + 1]);
-			try {
-				if (tree.insert(coordinate, rid))
-					cout << "Insertion done.\n";
-				else
-					cout << "Insertion failed.\n";
-			}
-			catch (bad_alloc& ba)  {
-				sprintf(msg, "bad_alloc caught <%s> ", ba.what());
-				error(msg);
-			}
-		}
-		return true;
-	}
-	else if (strcmp(args[0], "d") == 0) { // deletion.
-		if (num_arg != dimension + 1) {
-			sprintf(msg, "Wrong number of arguments for command 'd'");
-			error(msg);
-		}
-		else {
-			vector<int> coordinate;
-			for (int i = 0; i < dimension; i++)
-			{
-				int coord = atoi(args[i + 1]);
-				coordinate.push_back(coord);
-			}
-
-			if (tree.del(coordinate))
-				cout << "Deletion done.\n";
-			else
-				cout << "Deletion failed.\n";
-		}
-		return true;
-	}
-	else if (strcmp(args[0], "ri") == 0) { // random insertion.
-		if (num_arg != 3) {
-			sprintf(msg, "Wrong number of arguments for command 'ri'");
-			error(msg);
-		}
-		else {
-			srand(atoi(args[1]));
-			int num = atoi(args[2]);
-			int succeed = 0;
-			for (int i = 0; i < num; i++) {
-				vector<int> coordinate;
-				for (int j = 0; j < dimension; j++)
-				{
-					int coord = rand() % DOMAIN_SIZE;
-					coordinate.push_back(coord);
-				}
-				int rid = rand();
-				
-				try {
-					if (tree.insert(coordinate, rid)) {
-						succeed++;
-					}
-				}
-				catch (bad_alloc& ba)  {
-					sprintf(msg, "bad_alloc caught <%s> ", ba.what());
-					error(msg);
-				}
-				//tree.print_tree();
-			}
-			cout << succeed << " out of " << num << " insertion(s) suceeded.\n";
-		}
-		return true;
-	}
-	else if (strcmp(args[0], "rd") == 0) { // random deletion.
-		if (num_arg != 3) {
-			sprintf(msg, "Wrong number of arguments for command 'rd'");
-			error(msg);
-		}
-		else {
-			srand(atoi(args[1]));
-			int num = atoi(args[2]);
-			int succeed = 0;
-			for (int i = 0; i < num; i++) {
-				vector<int> coordinate;
-				for (int j = 0; j < dimension; j++)
-				{
-					int coord = rand() % DOMAIN_SIZE;
-					coordinate.push_back(coord);
-				}
-				int dummy = rand(); // to be compatible with ``ri''.
-				if (tree.del(coordinate)) {
-					succeed++;
-				}
-			}
-			cout << succeed << " out of " << num << " deletion(s) suceeded.\n";
-		}
-		return true;
-	}
-	else if (strcmp(args[0], "qr") == 0) { // range query.
-		if (num_arg != 1 + dimension * 2) {
-			sprintf(msg, "Wrong number of arguments for command 'qr'");
-			error(msg);
-		}
-		else {
-			vector<int> lowest;
-			vector<int> highest;
-			for (int i = 0; i < dimension; i++)
-			{
-				lowest.push_back(atoi(args[1 + i*2]));			
-				highest.push_back(atoi(args[2 + i*2]));
-			}
-
-			BoundingBox mbr(lowest, highest);
-
-			int result_count = 0;
-			int node_travelled = 0;
-			tree.query_range(mbr, result_count, node_travelled);
-			cout << "Number of results: " << result_count << endl;
-			cout << "Number of nodes visited: " << node_travelled << endl;
-		}
-		return true;
-	}
-	else if (strcmp(args[0], "qp") == 0) { // point query.
-		if (num_arg != 1 + dimension) {
-			sprintf(msg, "Wrong number of arguments for command 'qp'");
-			error(msg);
-		}
-		else {
-			Entry result;
-
-			vector<int> coordinate;
-
-			for (int i = 0; i < dimension; i++)
-			{
-				coordinate.push_back(atoi(args[i + 1]));
-			}
-
-			if (tree.query_point(coordinate, result)) {
-				cout << "Record: <";
-				BoundingBox resultP = result.get_mbr();
-				for (int i = 0; i < resultP.get_dim(); i++)
-				{
-					cout << resultP.get_lowestValue_at(i);
-					if (i != resultP.get_dim() - 1)
-					{
-						cout << ", ";
-					}
-				}
-				cout << ", " << result.get_rid()  << ">\n";
-			}
-			else {
-				cout << "Record not found.\n";
-			}
-		}
-		return true;
-	}
-	else if (strcmp(args[0], "s") == 0) { // statistics.
-		tree.stat();
-		return true;
-	}
-	else if (strcmp(args[0], "p") == 0) { // print tree.
-		tree.print_tree();
-		return true;
-	}
-	else if (strcmp(args[0], "h") == 0) { // print help menu.
-		help();
-		return true;
-	}
-	else if (strcmp(args[0], "x") == 0) { // exit
-		return false;
-	}
-	else {
-		sprintf(msg, "Invalid command '%s'.\nType 'h' to print the help menu.", args[0]);
-		error(msg);
-		return true;
-	}
-}
-
-
-
-int main(int argc, char *argv[])
-{//argc also counts the argv[0] that is the name of the program
-	
-	if (argc < 3) {
-		cerr << "Usage: " << argv[0] << " Max_#entries_in_a_node Dimensionality_of_Rtree\" [file_containing_commmands].\n";
-		return 0;
-	}
-
-	// Create an R-tree.
-	int max_entry_num = atoi(argv[1]);
-	if (max_entry_num < 2) {
-		cerr << "Number of entries should be an integer > 2.\n";
-		return 0;
-	}
-	int dimension = atoi(argv[2]);
-	RTree tree(max_entry_num, dimension);
-
-	// Processing input commands.
-	char command[MAX_CMD_LEN];
-	if (argc == 4) {
-		ifstream fin(argv[3]);
-		while (fin.getline(command, MAX_CMD_LEN)) {
-			//cout << command << endl;
-			if (! process(command, tree, dimension))
-				break;
-		}
-	}
-	else {
-		while (true) {
-			cout << ">> ";
-			cin.getline(command, MAX_CMD_LEN);
-			if (! process(command, tree, dimension))
-				break;
-		}
-	}
-
-	return 0;
-}
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <thread>
+#include "concurrent.h"
+#include "sharded.h"
+#include "threadpool.h"
+
+using namespace std;
+
+const int MAX_CMD_LEN = 256;
+const int DOMAIN_SIZE = 10000;
+
+void help()
+{
+	cout << "============================================================================\n";
+	cout << "Commands:\n";
+	cout << "============================================================================\n";
+	cout << "i x1(int) x2(int) ... xd(int) rid(int) : insert a record with d-dimension key (x1, x2,... , xd) and record id rid\n";
+	cout << "u x1(int) x2(int) ... xd(int) rid(int) : insert a record, or set the record id of the record with the same key\n";
+	cout << "d x1(int) x2(int) ... xd(int) : delete the record with key (x1, x2,... , xd)\n";
+	cout << "dk x1(int) x2(int) ... xd(int) rid(int) : delete the record with key (x1, x2,... , xd) and record id rid\n";
+	cout << "dr rid(int) : delete the record with record id rid\n";
+	cout << "mv rid(int) x1(int) ... xd(int) y1(int) ... yd(int) : move the record rid from key (x1, ... , xd) to (y1, ... , yd)\n";
+	cout << "ri s(int) num(int) : random insertions of num records with seed s\n";
+	cout << "rib s(int) num(int) : insert the records of ``ri s num'' as one batch\n";
+	cout << "bl s(int) num(int) [threads(int)] : bulk load the records of ``ri s num'', Sort-Tile-Recursive packing\n";
+	cout << "blh s(int) num(int) [threads(int)] : bulk load the records of ``ri s num'', Hilbert packing\n";
+	cout << "sb s(int) num(int) [queries(int)] : insert the records of ``ri s num'' with each split method,\n";
+	cout << "     report insertion time and nodes visited by random range queries\n";
+	cout << "ib s(int) num(int) buffer(int) : insert the records of ``ri s num'' one by one, then with node buffers\n";
+	cout << "     of the given size, report insertion throughput\n";
+	cout << "fl : push the buffered insertions down to the leaves\n";
+	cout << "rq s(int) num(int) threads(int) [queries(int)] : load the records of ``ri s num'' into a shared tree and run\n";
+	cout << "     random range queries from 1, 2, 4, ... up to threads threads, report the query throughput\n";
+	cout << "sq s(int) num(int) threads(int) : load half of the records of ``ri s num'', insert the other half one by one\n";
+	cout << "     while threads threads run random range queries, behind a lock then on snapshots, report both throughputs\n";
+	cout << "ci s(int) num(int) threads(int) : insert the records of ``ri s num'' from 1, 2, 4, ... up to threads threads,\n";
+	cout << "     with latched insertion then behind a lock, report the insertion throughput\n";
+	cout << "pq s(int) num(int) threads(int) [queries(int)] : bulk load the records of ``ri s num'' and run small and large\n";
+	cout << "     random range queries serially then on a pool of threads threads, report the query times\n";
+	cout << "bq s(int) num(int) threads(int) [queries(int)] : bulk load the records of ``ri s num'' and run random range\n";
+	cout << "     queries one by one, as one batch, then as one batch on threads threads, report the query times\n";
+	cout << "sh s(int) num(int) shards(int) threads(int) : insert the records of ``ri s num'' from threads threads into a tree\n";
+	cout << "     of shards shards then behind a lock, and run random range and 10-nearest queries, report the throughputs\n";
+	cout << "jn s(int) num1(int) num2(int) threads(int) : bulk load two trees of num1 and num2 random small boxes and join\n";
+	cout << "     them by range queries, by synchronized traversal, then on threads threads, report the join times\n";
+	cout << "ej s(int) num(int) eps(int) : bulk load the records of ``ri s num'' and find the pairs within distance eps,\n";
+	cout << "     by a range query per record then by a self-join, report both times\n";
+	cout << "cp : remove the tombstones left by lazy deletion\n";
+	cout << "rd s(int) num(int) : random deletions of num records with seed s\n";
+	cout << "rdb s(int) num(int) : delete the records of ``rd s num'' as one batch\n";
+	cout << "qp x1(int) x2(int) ... xd(int) : query the record with key (x1, x2, ... , xd)\n";
+	cout << "qr x1min(int) x1max(int) x2min(int) x2max(int) ... xdmin(int) xdmax(int) : find records inside range\n";
+	cout << "     where ximin<=xi<=ximax\n";
+	cout << "qrl x1min(int) x1max(int) ... xdmin(int) xdmax(int) : list records inside range\n";
+	cout << "qk x1(int) x2(int) ... xd(int) k(int) : find the k records nearest to (x1, x2, ... , xd)\n";
+	cout << "s : print the statistic information of the tree\n";
+	cout << "p : print the tree\n";
+	cout << "h : show this help menu\n";
+	cout << "x : exit\n";
+	cout << "============================================================================\n";
+}
+
+void error(const char* cmd)
+{
+	cerr << "Error: " << cmd << endl;
+}
+
+template <int D>
+void print_record(const Entry<D>& result)
+{
+	cout << "Record: <";
+	const BoundingBox<D>& resultP = result.get_mbr();
+	for (int i = 0; i < resultP.get_dim(); i++)
+	{
+		cout << resultP.get_lowestValue_at(i);
+		if (i != resultP.get_dim() - 1)
+		{
+			cout << ", ";
+		}
+	}
+	cout << ", " << result.get_rid()  << ">\n";
+}
+
+//
+// The records of ``ri seed num'': ``num'' random points of the domain with random record ids.
+//
+template <int D>
+vector<Entry<D> > random_records(int seed, int num, int dimension)
+{
+	srand(seed);
+	vector<Entry<D> > records;
+	records.reserve(num);
+	for (int i = 0; i < num; i++) {
+		vector<int> coordinate;
+		for (int j = 0; j < dimension; j++)
+		{
+			coordinate.push_back(rand() % DOMAIN_SIZE);
+		}
+		int rid = rand();
+		records.push_back(Entry<D>(BoundingBox<D>(coordinate, coordinate), rid));
+	}
+	return records;
+}
+
+//
+// ``num'' random square windows of the domain with sides ``side'', drawn after the records.
+//
+template <int D>
+vector<BoundingBox<D> > random_windows(int num, int side, int dimension)
+{
+	vector<BoundingBox<D> > windows;
+	windows.reserve(num);
+	for (int i = 0; i < num; i++) {
+		vector<int> low, high;
+		for (int j = 0; j < dimension; j++)
+		{
+			int coord = rand() % (DOMAIN_SIZE - side);
+			low.push_back(coord);
+			high.push_back(coord + side);
+		}
+		windows.push_back(BoundingBox<D>(low, high));
+	}
+	return windows;
+}
+
+// The key of the point record ``e''.
+template <int D>
+vector<int> record_key(const Entry<D>& e, int dimension)
+{
+	const int* lowest = e.get_mbr().get_lowest();
+	return vector<int>(lowest, lowest + dimension);
+}
+
+//
+// Insert the records of ``ri seed num'' into a fresh tree per split method and
+// report the insertion time and the nodes visited by ``query_num'' random range queries.
+//
+template <int D>
+void split_benchmark(int seed, int num, int query_num, int max_entry_num, int dimension)
+{
+	const char* names[] = {"linear", "quadratic", "rstar", "exhaustive"};
+	const SplitMethod methods[] = {LINEAR_SPLIT, QUADRATIC_SPLIT, RSTAR_SPLIT, EXHAUSTIVE_SPLIT};
+
+	vector<Entry<D> > records = random_records<D>(seed, num, dimension);
+	// square windows covering 1/20 of the domain in each dimension.
+	vector<BoundingBox<D> > queries = random_windows<D>(query_num, DOMAIN_SIZE / 20, dimension);
+
+	for (int m = 0; m < 4; m++) {
+		RTree<D> tree(max_entry_num, dimension, GUTTMAN_INSERT, methods[m]);
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		for (int i = 0; i < num; i++) {
+			tree.insert(record_key(records[i], dimension), records[i].get_rid());
+		}
+		double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+		long long visited = 0;
+		for (int i = 0; i < query_num; i++) {
+			int result_count = 0;
+			int node_travelled = 0;
+			tree.query_range(queries[i], result_count, node_travelled);
+			visited += node_travelled;
+		}
+		cout << names[m] << ": insert time " << ms << " ms, " << visited << " node(s) visited by "
+			<< query_num << " range queries, fill factor " << tree.fill_factor() << endl;
+	}
+}
+
+//
+// Insert the records of ``ri seed num'' into a fresh tree one by one, then into
+// another with node buffers of ``buffer_size'' records, and report the throughput.
+// The buffered time includes the final flush.
+//
+template <int D>
+void buffer_benchmark(int seed, int num, int buffer_size, int max_entry_num, int dimension)
+{
+	vector<Entry<D> > records = random_records<D>(seed, num, dimension);
+
+	for (int b = 0; b < 2; b++) {
+		RTree<D> tree(max_entry_num, dimension);
+		tree.set_buffer_size(b == 0 ? 0 : buffer_size);
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		for (int i = 0; i < num; i++) {
+			tree.insert(record_key(records[i], dimension), records[i].get_rid());
+		}
+		tree.flush();
+		double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+		cout << (b == 0 ? "plain" : "buffered") << ": insert time " << ms << " ms, "
+			<< (long long)(num / (ms / 1000)) << " insertion(s) per second\n";
+	}
+}
+
+//
+// Load the records of ``ri seed num'' into a tree shared by threads and run ``query_num''
+// random range queries, split among 1, 2, 4, ... up to ``thread_num'' threads.
+//
+template <int D>
+void read_benchmark(int seed, int num, int thread_num, int query_num, int max_entry_num, int dimension)
+{
+	vector<Entry<D> > records = random_records<D>(seed, num, dimension);
+	// square windows covering 1/100 of the domain in each dimension.
+	vector<BoundingBox<D> > queries = random_windows<D>(query_num, DOMAIN_SIZE / 100, dimension);
+
+	ConcurrentRTree<D> tree(max_entry_num, dimension);
+	tree.insert_batch(records);
+	for (int t = 1; ; t = min(t * 2, thread_num)) {
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		vector<thread> readers;
+		for (int r = 0; r < t; r++) {
+			readers.push_back(thread([&tree, &queries, r, t]() {
+				for (size_t i = r; i < queries.size(); i += t) {
+					int result_count = 0;
+					int node_travelled = 0;
+					tree.query_range(queries[i], result_count, node_travelled);
+				}
+			}));
+		}
+		for (int r = 0; r < t; r++)
+			readers[r].join();
+		double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+		cout << t << " thread(s): " << ms << " ms, " << (long long)(query_num / (ms / 1000)) << " queries per second\n";
+		if (t == thread_num)
+			break;
+	}
+}
+
+//
+// Insert the records ``keys'' and ``rids'' one by one with ``insert'' while ``thread_num'' threads
+// run the range queries ``queries'' over and over with ``query'', and report both throughputs.
+//
+template <int D>
+void ingest_run(const char* name, const vector<vector<int> >& keys, const vector<int>& rids,
+	const vector<BoundingBox<D> >& queries, int thread_num,
+	const function<void(const vector<int>&, int)>& insert, const function<void(const BoundingBox<D>&)>& query)
+{
+	atomic<bool> done(false);
+	atomic<long long> query_cnt(0);
+	vector<thread> readers;
+	for (int r = 0; r < thread_num; r++) {
+		readers.push_back(thread([&, r]() {
+			long long cnt = 0;
+			for (size_t i = r; !done.load(); i = (i + thread_num) % queries.size()) {
+				query(queries[i]);
+				cnt++;
+			}
+			query_cnt += cnt;
+		}));
+	}
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	for (size_t i = 0; i < keys.size(); i++)
+		insert(keys[i], rids[i]);
+	double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+	done.store(true);
+	for (int r = 0; r < thread_num; r++)
+		readers[r].join();
+	cout << name << ": " << (long long)(keys.size() / (ms / 1000)) << " insertions per second, "
+		<< (long long)(query_cnt.load() / (ms / 1000)) << " queries per second\n";
+}
+
+//
+// Ingestion under concurrent range queries: into a ConcurrentRTree, then into an RTree
+// in snapshot mode publishing after each insertion.
+//
+template <int D>
+void ingest_benchmark(int seed, int num, int thread_num, int max_entry_num, int dimension)
+{
+	vector<Entry<D> > loaded = random_records<D>(seed, num, dimension);
+	vector<vector<int> > keys;
+	vector<int> rids;
+	for (int i = num / 2; i < num; i++) {
+		keys.push_back(record_key(loaded[i], dimension));
+		rids.push_back(loaded[i].get_rid());
+	}
+	loaded.resize(num / 2);
+	// square windows covering 1/100 of the domain in each dimension.
+	vector<BoundingBox<D> > queries = random_windows<D>(10000, DOMAIN_SIZE / 100, dimension);
+
+	ConcurrentRTree<D> locked(max_entry_num, dimension);
+	locked.insert_batch(loaded);
+	ingest_run<D>("Locked", keys, rids, queries, thread_num,
+		[&locked](const vector<int>& key, int rid) { locked.insert(key, rid); },
+		[&locked](const BoundingBox<D>& mbr) {
+			int result_count, node_travelled;
+			locked.query_range(mbr, result_count, node_travelled);
+		});
+
+	RTree<D> snapshot(max_entry_num, dimension);
+	snapshot.insert_batch(loaded);
+	snapshot.set_snapshots(true);
+	ingest_run<D>("Snapshots", keys, rids, queries, thread_num,
+		[&snapshot](const vector<int>& key, int rid) { snapshot.insert(key, rid); snapshot.publish(); },
+		[&snapshot](const BoundingBox<D>& mbr) {
+			int result_count, node_travelled;
+			snapshot.query_range(mbr, result_count, node_travelled);
+		});
+}
+
+//
+// Insert ``records'' from ``thread_num'' threads, each taking every thread_num-th record, with ``insert''.
+// Return: the time taken in milliseconds.
+//
+template <int D>
+double insert_run(const vector<Entry<D> >& records, int thread_num, const function<void(const Entry<D>&)>& insert)
+{
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	vector<thread> writers;
+	for (int w = 0; w < thread_num; w++) {
+		writers.push_back(thread([&, w]() {
+			for (size_t i = w; i < records.size(); i += thread_num)
+				insert(records[i]);
+		}));
+	}
+	for (int w = 0; w < thread_num; w++)
+		writers[w].join();
+	return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+//
+// Concurrent insertion into an RTree with insert_latched(), and into a ConcurrentRTree.
+//
+template <int D>
+void latched_benchmark(int seed, int num, int thread_num, int max_entry_num, int dimension)
+{
+	vector<Entry<D> > records = random_records<D>(seed, num, dimension);
+	vector<int> low(dimension, 0), high(dimension, DOMAIN_SIZE);
+	BoundingBox<D> domain(low, high);
+
+	for (int t = 1; ; t = min(t * 2, thread_num)) {
+		RTree<D> latched(max_entry_num, dimension);
+		double latched_ms = insert_run<D>(records, t, [&latched, dimension](const Entry<D>& e) {
+			latched.insert_latched(record_key(e, dimension), e.get_rid());
+		});
+		int result_count, node_travelled;
+		latched.query_range_latched(domain, result_count, node_travelled);
+
+		ConcurrentRTree<D> locked(max_entry_num, dimension);
+		double locked_ms = insert_run<D>(records, t, [&locked, dimension](const Entry<D>& e) {
+			locked.insert(record_key(e, dimension), e.get_rid());
+		});
+		cout << t << " thread(s): latched " << (long long)(num / (latched_ms / 1000)) << " insertions per second ("
+			<< result_count << " records), locked " << (long long)(num / (locked_ms / 1000)) << " insertions per second\n";
+		if (t == thread_num)
+			break;
+	}
+}
+
+//
+// Random range queries on the records of ``ri seed num'', serial and parallel, with windows
+// covering 1/100 then 1/4 of the domain in each dimension.
+//
+template <int D>
+void parallel_query_benchmark(int seed, int num, int thread_num, int query_num, int max_entry_num, int dimension)
+{
+	vector<Entry<D> > records = random_records<D>(seed, num, dimension);
+	RTree<D> tree(max_entry_num, dimension);
+	tree.bulk_load(records, STR_LOAD);
+	ThreadPool pool(thread_num);
+
+	for (int side = DOMAIN_SIZE / 100; side <= DOMAIN_SIZE / 4; side = DOMAIN_SIZE / 4) {
+		vector<BoundingBox<D> > queries = random_windows<D>(query_num, side, dimension);
+		long long serial_cnt = 0, parallel_cnt = 0;
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		for (int i = 0; i < query_num; i++) {
+			int result_count, node_travelled;
+			tree.query_range(queries[i], result_count, node_travelled);
+			serial_cnt += result_count;
+		}
+		double serial_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+		start = chrono::steady_clock::now();
+		for (int i = 0; i < query_num; i++) {
+			int result_count, node_travelled;
+			tree.query_range(queries[i], result_count, node_travelled, pool);
+			parallel_cnt += result_count;
+		}
+		double parallel_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+		cout << "window " << side << ": serial " << serial_ms / query_num << " ms, " << thread_num << " thread(s) "
+			<< parallel_ms / query_num << " ms per query, " << serial_cnt << "/" << parallel_cnt << " records\n";
+		if (side == DOMAIN_SIZE / 4)
+			break;
+	}
+}
+
+//
+// Random range queries on the records of ``ri seed num'', one at a time and batched.
+//
+template <int D>
+void batch_query_benchmark(int seed, int num, int thread_num, int query_num, int max_entry_num, int dimension)
+{
+	vector<Entry<D> > records = random_records<D>(seed, num, dimension);
+	// square windows covering 1/100 of the domain in each dimension.
+	vector<BoundingBox<D> > queries = random_windows<D>(query_num, DOMAIN_SIZE / 100, dimension);
+	RTree<D> tree(max_entry_num, dimension);
+	tree.bulk_load(records, STR_LOAD);
+
+	long long result_cnt = 0, node_cnt = 0;
+	vector<Entry<D> > results;
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	for (int i = 0; i < query_num; i++) {
+		int node_travelled;
+		results.clear();
+		tree.query_range(queries[i], results, node_travelled);
+		result_cnt += results.size();
+		node_cnt += node_travelled;
+	}
+	double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+	cout << "one by one: " << ms << " ms, " << result_cnt << " records, " << node_cnt << " nodes visited\n";
+
+	ThreadPool pool(thread_num);
+	for (int t = 1; ; t = thread_num) {
+		vector<vector<Entry<D> > > batch_results;
+		int node_travelled;
+		start = chrono::steady_clock::now();
+		if (t == 1)
+			tree.query_range_batch(queries, batch_results, node_travelled);
+		else
+			tree.query_range_batch(queries, batch_results, node_travelled, pool);
+		ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+		result_cnt = 0;
+		for (int i = 0; i < query_num; i++)
+			result_cnt += batch_results[i].size();
+		cout << "batch, " << t << " thread(s): " << ms << " ms, " << result_cnt << " records, " << node_travelled << " nodes visited\n";
+		if (t == thread_num)
+			break;
+	}
+}
+
+//
+// Run ``query_num'' queries from ``thread_num'' threads with ``query'', each taking every thread_num-th one.
+// Return: the time taken in milliseconds.
+//
+double query_run(int query_num, int thread_num, const function<void(int)>& query)
+{
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	vector<thread> readers;
+	for (int r = 0; r < thread_num; r++) {
+		readers.push_back(thread([&, r]() {
+			for (int i = r; i < query_num; i += thread_num)
+				query(i);
+		}));
+	}
+	for (int r = 0; r < thread_num; r++)
+		readers[r].join();
+	return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+//
+// Insertion, range and kNN queries from ``thread_num'' threads on a ShardedRTree and on a ConcurrentRTree.
+//
+template <int D>
+void shard_benchmark(int seed, int num, int shard_num, int thread_num, int max_entry_num, int dimension)
+{
+	vector<Entry<D> > records = random_records<D>(seed, num, dimension);
+	const int query_num = 100000;
+	vector<BoundingBox<D> > queries = random_windows<D>(query_num, DOMAIN_SIZE / 100, dimension);
+	// the kNN queries start from the window corners.
+	vector<vector<int> > points;
+	for (int i = 0; i < query_num; i++)
+		points.push_back(vector<int>(queries[i].get_lowest(), queries[i].get_lowest() + dimension));
+
+	ShardedRTree<D> sharded(max_entry_num, dimension, shard_num);
+	double sharded_ms = insert_run<D>(records, thread_num, [&](const Entry<D>& e) { sharded.insert(record_key(e, dimension), e.get_rid()); });
+	ConcurrentRTree<D> locked(max_entry_num, dimension);
+	double locked_ms = insert_run<D>(records, thread_num, [&](const Entry<D>& e) { locked.insert(record_key(e, dimension), e.get_rid()); });
+	cout << "insertion: sharded " << (long long)(num / (sharded_ms / 1000)) << ", locked "
+		<< (long long)(num / (locked_ms / 1000)) << " per second\n";
+	sharded.stat();
+
+	atomic<long long> sharded_cnt(0), locked_cnt(0);
+	sharded_ms = query_run(query_num, thread_num, [&](int i) {
+		int result_count, node_travelled;
+		sharded.query_range(queries[i], result_count, node_travelled);
+		sharded_cnt += result_count;
+	});
+	locked_ms = query_run(query_num, thread_num, [&](int i) {
+		int result_count, node_travelled;
+		locked.query_range(queries[i], result_count, node_travelled);
+		locked_cnt += result_count;
+	});
+	cout << "range queries: sharded " << (long long)(query_num / (sharded_ms / 1000)) << ", locked "
+		<< (long long)(query_num / (locked_ms / 1000)) << " per second, " << sharded_cnt << "/" << locked_cnt << " records\n";
+
+	sharded_ms = query_run(query_num, thread_num, [&](int i) {
+		vector<Entry<D> > results;
+		int node_travelled;
+		sharded.query_knn(points[i], 10, results, node_travelled);
+	});
+	locked_ms = query_run(query_num, thread_num, [&](int i) {
+		vector<Entry<D> > results;
+		int node_travelled;
+		locked.query_knn(points[i], 10, results, node_travelled);
+	});
+	cout << "10-nearest queries: sharded " << (long long)(query_num / (sharded_ms / 1000)) << ", locked "
+		<< (long long)(query_num / (locked_ms / 1000)) << " per second\n";
+}
+
+// Counts the pairs of a join, from any number of threads.
+template <int D>
+class PairCounter : public EntryPairVisitor<D> {
+	public:
+		PairCounter() : pairs(0) {}
+		bool visit(const Entry<D>&, const Entry<D>&) { pairs++; return true; }
+
+		atomic<long long> pairs;
+};
+
+// Passes the records found by a range query on to a join visitor, paired with the query record.
+template <int D>
+class PairForwarder : public EntryVisitor<D> {
+	public:
+		PairForwarder(const Entry<D>& e, EntryPairVisitor<D>& v) : left(e), visitor(v) {}
+		bool visit(const Entry<D>& e) { return visitor.visit(left, e); }
+
+	private:
+		const Entry<D>& left;
+		EntryPairVisitor<D>& visitor;
+};
+
+//
+// Join two trees of random boxes with sides up to 1/200 of the domain, as an index nested loop,
+// then with join() on one and on ``thread_num'' threads.
+//
+template <int D>
+void join_benchmark(int seed, int num1, int num2, int thread_num, int max_entry_num, int dimension)
+{
+	srand(seed);
+	vector<Entry<D> > records[2];
+	for (int t = 0; t < 2; t++) {
+		int num = t == 0 ? num1 : num2;
+		for (int i = 0; i < num; i++) {
+			vector<int> low, high;
+			for (int j = 0; j < dimension; j++)
+			{
+				int coord = rand() % DOMAIN_SIZE;
+				low.push_back(coord);
+				high.push_back(coord + rand() % (DOMAIN_SIZE / 200));
+			}
+			records[t].push_back(Entry<D>(BoundingBox<D>(low, high), i));
+		}
+	}
+	RTree<D> tree1(max_entry_num, dimension), tree2(max_entry_num, dimension);
+	tree1.bulk_load(records[0], STR_LOAD);
+	tree2.bulk_load(records[1], STR_LOAD);
+
+	PairCounter<D> nested;
+	long long node_cnt = 0;
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	for (int i = 0; i < num1; i++) {
+		PairForwarder<D> forwarder(records[0][i], nested);
+		int node_travelled;
+		tree2.query_range(records[0][i].get_mbr(), forwarder, node_travelled);
+		node_cnt += node_travelled;
+	}
+	double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+	cout << "nested loop: " << ms << " ms, " << nested.pairs << " pairs, " << node_cnt << " nodes visited\n";
+
+	ThreadPool pool(thread_num);
+	for (int t = 1; ; t = thread_num) {
+		PairCounter<D> counter;
+		int node_travelled;
+		start = chrono::steady_clock::now();
+		if (t == 1)
+			tree1.join(tree2, counter, node_travelled);
+		else
+			tree1.join(tree2, counter, node_travelled, pool);
+		ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+		cout << "join, " << t << " thread(s): " << ms << " ms, " << counter.pairs << " pairs, " << node_travelled << " nodes visited\n";
+		if (t == thread_num)
+			break;
+	}
+}
+
+// Counts the records of a range query within ``eps'' of a point record with a lower record id.
+template <int D>
+class NearCounter : public EntryVisitor<D> {
+	public:
+		NearCounter(const Entry<D>& e, int d) : center(e), eps(d), pairs(0) {}
+		bool visit(const Entry<D>& e) {
+			if (e.get_rid() > center.get_rid() && e.get_mbr().get_mindist(center.get_mbr().get_lowest()) <= (double)eps * eps)
+				pairs++;
+			return true;
+		}
+
+		const Entry<D>& center;
+		int eps;
+		long long pairs;
+};
+
+//
+// Pairs of the records of ``ri seed num'' within distance ``eps'', by a range query around
+// each record, then with self_join().
+//
+template <int D>
+void self_join_benchmark(int seed, int num, int eps, int max_entry_num, int dimension)
+{
+	vector<Entry<D> > records = random_records<D>(seed, num, dimension);
+	// distinct record ids, which order the pairs of the range queries.
+	for (int i = 0; i < num; i++)
+		records[i].set_rid(i);
+	RTree<D> tree(max_entry_num, dimension);
+	tree.bulk_load(records, STR_LOAD);
+	// bulk loading drops the records with a key already taken.
+	vector<int> lowest(dimension, 0), highest(dimension, DOMAIN_SIZE);
+	int node_travelled;
+	records.clear();
+	tree.query_range(BoundingBox<D>(lowest, highest), records, node_travelled);
+
+	long long pairs = 0, node_cnt = 0;
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	for (size_t i = 0; i < records.size(); i++) {
+		vector<int> low, high;
+		for (int j = 0; j < dimension; j++) {
+			low.push_back(records[i].get_mbr().get_lowestValue_at(j) - eps);
+			high.push_back(records[i].get_mbr().get_highestValue_at(j) + eps);
+		}
+		NearCounter<D> counter(records[i], eps);
+		tree.query_range(BoundingBox<D>(low, high), counter, node_travelled);
+		pairs += counter.pairs;
+		node_cnt += node_travelled;
+	}
+	double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+	cout << "range queries: " << ms << " ms, " << pairs << " pairs, " << node_cnt << " nodes visited\n";
+
+	PairCounter<D> counter;
+	start = chrono::steady_clock::now();
+	tree.self_join(eps, counter, node_travelled);
+	ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+	cout << "self-join: " << ms << " ms, " << counter.pairs << " pairs, " << node_travelled << " nodes visited\n";
+}
+
+template <int D>
+bool process(char* cmd, RTree<D>& tree, int dimension)
+{
+	
+	const int MAX_ARG_NUM = 256; // limit to at most 256 arguments
+	char* args[MAX_ARG_NUM];
+	
+	char msg[1024]; // error message.
+	int actualMaxArgNum = 2 + dimension * 2;
+	if (actualMaxArgNum > MAX_ARG_NUM)
+	{
+		sprintf(msg, "Too many command arguments");
+		error(msg);
+		return true;
+	}
+	int num_arg = 0;
+	char* token = strtok(cmd, "\n \t");
+	for (; token != NULL && num_arg < actualMaxArgNum; num_arg++) {
+		args[num_arg] = token;
+		token = strtok(NULL, " \t");
+	}
+	if (num_arg == 0 || token != NULL) {
+		sprintf(msg, "Wrong number of command arguments");
+		error(msg);
+		return true;
+	}
+	if (strcmp(args[0], "i") == 0) { // insertion.
+		if (num_arg != dimension + 2) {
+			sprintf(msg, "Wrong number of arguments for command 'i'");
+			error(msg);
+		}
+		else {
+			//insert a point, modelled by a bounding box
+			vector<int> coordinate;
+			for (int i = 0; i < dimension; i++)
+			{
+				int coord = atoi(args[i + 1]);
+				coordinate.push_back(coord);
+			}
+			int rid = atoi(args[dimension + 1]);
+			try {
+				if (tree.insert(coordinate, rid))
+					cout << "Insertion done.\n";
+				else
+					cout << "Insertion failed.\n";
+			}
+			catch (bad_alloc& ba)  {
+				sprintf(msg, "bad_alloc caught <%s> ", ba.what());
+				error(msg);
+			}
+		}
+		return true;
+	}
+	else if (strcmp(args[0], "u") == 0) { // upsert.
+		if (num_arg != dimension + 2) {
+			sprintf(msg, "Wrong number of arguments for command 'u'");
+			error(msg);
+		}
+		else {
+			vector<int> coordinate;
+			for (int i = 0; i < dimension; i++)
+			{
+				int coord = atoi(args[i + 1]);
+				coordinate.push_back(coord);
+			}
+			int rid = atoi(args[dimension + 1]);
+			try {
+				if (tree.upsert(coordinate, rid))
+					cout << "Insertion done.\n";
+				else
+					cout << "Record updated.\n";
+			}
+			catch (bad_alloc& ba)  {
+				sprintf(msg, "bad_alloc caught <%s> ", ba.what());
+				error(msg);
+			}
+		}
+		return true;
+	}
+	else if (strcmp(args[0], "d") == 0) { // deletion.
+		if (num_arg != dimension + 1) {
+			sprintf(msg, "Wrong number of arguments for command 'd'");
+			error(msg);
+		}
+		else {
+			vector<int> coordinate;
+			for (int i = 0; i < dimension; i++)
+			{
+				int coord = atoi(args[i + 1]);
+				coordinate.push_back(coord);
+			}
+
+			if (tree.del(coordinate))
+				cout << "Deletion done.\n";
+			else
+				cout << "Deletion failed.\n";
+		}
+		return true;
+	}
+	else if (strcmp(args[0], "dk") == 0) { // deletion by key and record id.
+		if (num_arg != dimension + 2) {
+			sprintf(msg, "Wrong number of arguments for command 'dk'");
+			error(msg);
+		}
+		else {
+			vector<int> coordinate;
+			for (int i = 0; i < dimension; i++)
+			{
+				int coord = atoi(args[i + 1]);
+				coordinate.push_back(coord);
+			}
+
+			if (tree.del(coordinate, atoi(args[dimension + 1])))
+				cout << "Deletion done.\n";
+			else
+				cout << "Deletion failed.\n";
+		}
+		return true;
+	}
+	else if (strcmp(args[0], "dr") == 0) { // deletion by record id.
+		if (num_arg != 2) {
+			sprintf(msg, "Wrong number of arguments for command 'dr'");
+			error(msg);
+		}
+		else {
+			if (tree.del_rid(atoi(args[1])))
+				cout << "Deletion done.\n";
+			else
+				cout << "Deletion failed.\n";
+		}
+		return true;
+	}
+	else if (strcmp(args[0], "mv") == 0) { // move a record.
+		if (num_arg != dimension * 2 + 2) {
+			sprintf(msg, "Wrong number of arguments for command 'mv'");
+			error(msg);
+		}
+		else {
+			vector<int> old_coord, new_coord;
+			for (int i = 0; i < dimension; i++)
+			{
+				old_coord.push_back(atoi(args[i + 2]));
+				new_coord.push_back(atoi(args[dimension + i + 2]));
+			}
+
+			if (tree.update(atoi(args[1]), old_coord, new_coord))
+				cout << "Update done.\n";
+			else
+				cout << "Update failed.\n";
+		}
+		return true;
+	}
+	else if (strcmp(args[0], "ri") == 0) { // random insertion.
+		if (num_arg != 3) {
+			sprintf(msg, "Wrong number of arguments for command 'ri'");
+			error(msg);
+		}
+		else {
+			srand(atoi(args[1]));
+			int num = atoi(args[2]);
+			int succeed = 0;
+			for (int i = 0; i < num; i++) {
+				vector<int> coordinate;
+				for (int j = 0; j < dimension; j++)
+				{
+					int coord = rand() % DOMAIN_SIZE;
+					coordinate.push_back(coord);
+				}
+				int rid = rand();
+				
+				try {
+					if (tree.insert(coordinate, rid)) {
+						succeed++;
+					}
+				}
+				catch (bad_alloc& ba)  {
+					sprintf(msg, "bad_alloc caught <%s> ", ba.what());
+					error(msg);
+				}
+				//tree.print_tree();
+			}
+			cout << succeed << " out of " << num << " insertion(s) suceeded.\n";
+		}
+		return true;
+	}
+	else if (strcmp(args[0], "rib") == 0) { // random insertions in one batch.
+		if (num_arg != 3) {
+			sprintf(msg, "Wrong number of arguments for command 'rib'");
+			error(msg);
+		}
+		else {
+			// the same records as ``ri'' with the same seed.
+			int num = atoi(args[2]);
+			vector<Entry<D> > records = random_records<D>(atoi(args[1]), num, dimension);
+
+			chrono::steady_clock::time_point start = chrono::steady_clock::now();
+			int succeed = tree.insert_batch(records);
+			double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+			cout << succeed << " out of " << num << " insertion(s) suceeded.\n";
+			cout << "Insert time: " << ms << " ms\n";
+		}
+		return true;
+	}
+	else if (strcmp(args[0], "bl") == 0 || strcmp(args[0], "blh") == 0) { // bulk loading of random records.
+		if (num_arg != 3 && num_arg != 4) {
+			sprintf(msg, "Wrong number of arguments for command '%s'", args[0]);
+			error(msg);
+		}
+		else {
+			// the same records as ``ri'' with the same seed.
+			int num = atoi(args[2]);
+			vector<Entry<D> > records = random_records<D>(atoi(args[1]), num, dimension);
+
+			chrono::steady_clock::time_point start = chrono::steady_clock::now();
+			int thread_num = num_arg == 4 ? atoi(args[3]) : 1;
+			int loaded = tree.bulk_load(records, strcmp(args[0], "bl") == 0 ? STR_LOAD : HILBERT_LOAD, thread_num);
+			double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+			cout << loaded << " out of " << num << " record(s) loaded.\n";
+			cout << "Build time: " << ms << " ms\n";
+			cout << "Fill factor: " << tree.fill_factor() << endl;
+		}
+		return true;
+	}
+	else if (strcmp(args[0], "sb") == 0) { // split method benchmark.
+		if (num_arg != 3 && num_arg != 4) {
+			sprintf(msg, "Wrong number of arguments for command 'sb'");
+			error(msg);
+		}
+		else {
+			int query_num = num_arg == 4 ? atoi(args[3]) : 1000;
+			split_benchmark<D>(atoi(args[1]), atoi(args[2]), query_num, tree.get_max_entry_num(), dimension);
+		}
+		return true;
+	}
+	else if (strcmp(args[0], "ib") == 0) { // buffered insertion benchmark.
+		if (num_arg != 4 || atoi(args[3]) <= 0) {
+			sprintf(msg, "Wrong arguments for command 'ib'");
+			error(msg);
+		}
+		else {
+			buffer_benchmark<D>(atoi(args[1]), atoi(args[2]), atoi(args[3]), tree.get_max_entry_num(), dimension);
+		}
+		return true;
+	}
+	else if (strcmp(args[0], "rq") == 0) { // concurrent range query benchmark.
+		if ((num_arg != 4 && num_arg != 5) || atoi(args[3]) <= 0) {
+			sprintf(msg, "Wrong arguments for command 'rq'");
+			error(msg);
+		}
+		else {
+			int query_num = num_arg == 5 ? atoi(args[4]) : 100000;
+			read_benchmark<D>(atoi(args[1]), atoi(args[2]), atoi(args[3]), query_num, tree.get_max_entry_num(), dimension);
+		}
+		return true;
+	}
+	else if (strcmp(args[0], "sq") == 0) { // ingestion under concurrent queries.
+		if (num_arg != 4 || atoi(args[3]) <= 0) {
+			sprintf(msg, "Wrong arguments for command 'sq'");
+			error(msg);
+		}
+		else {
+			ingest_benchmark<D>(atoi(args[1]), atoi(args[2]), atoi(args[3]), tree.get_max_entry_num(), dimension);
+		}
+		return true;
+	}
+	else if (strcmp(args[0], "ci") == 0) { // concurrent insertion benchmark.
+		if (num_arg != 4 || atoi(args[3]) <= 0) {
+			sprintf(msg, "Wrong arguments for command 'ci'");
+			error(msg);
+		}
+		else {
+			latched_benchmark<D>(atoi(args[1]), atoi(args[2]), atoi(args[3]), tree.get_max_entry_num(), dimension);
+		}
+		return true;
+	}
+	else if (strcmp(args[0], "pq") == 0) { // parallel range query benchmark.
+		if ((num_arg != 4 && num_arg != 5) || atoi(args[3]) <= 0) {
+			sprintf(msg, "Wrong arguments for command 'pq'");
+			error(msg);
+		}
+		else {
+			int query_num = num_arg == 5 ? atoi(args[4]) : 100;
+			parallel_query_benchmark<D>(atoi(args[1]), atoi(args[2]), atoi(args[3]), query_num, tree.get_max_entry_num(), dimension);
+		}
+		return true;
+	}
+	else if (strcmp(args[0], "bq") == 0) { // batched range query benchmark.
+		if ((num_arg != 4 && num_arg != 5) || atoi(args[3]) <= 0) {
+			sprintf(msg, "Wrong arguments for command 'bq'");
+			error(msg);
+		}
+		else {
+			int query_num = num_arg == 5 ? atoi(args[4]) : 100000;
+			batch_query_benchmark<D>(atoi(args[1]), atoi(args[2]), atoi(args[3]), query_num, tree.get_max_entry_num(), dimension);
+		}
+		return true;
+	}
+	else if (strcmp(args[0], "sh") == 0) { // sharded tree benchmark.
+		if (num_arg != 5 || atoi(args[3]) <= 0 || atoi(args[4]) <= 0) {
+			sprintf(msg, "Wrong arguments for command 'sh'");
+			error(msg);
+		}
+		else {
+			shard_benchmark<D>(atoi(args[1]), atoi(args[2]), atoi(args[3]), atoi(args[4]), tree.get_max_entry_num(), dimension);
+		}
+		return true;
+	}
+	else if (strcmp(args[0], "jn") == 0) { // spatial join benchmark.
+		if (num_arg != 5 || atoi(args[4]) <= 0) {
+			sprintf(msg, "Wrong arguments for command 'jn'");
+			error(msg);
+		}
+		else {
+			join_benchmark<D>(atoi(args[1]), atoi(args[2]), atoi(args[3]), atoi(args[4]), tree.get_max_entry_num(), dimension);
+		}
+		return true;
+	}
+	else if (strcmp(args[0], "ej") == 0) { // distance self-join benchmark.
+		if (num_arg != 4 || atoi(args[3]) < 0) {
+			sprintf(msg, "Wrong arguments for command 'ej'");
+			error(msg);
+		}
+		else {
+			self_join_benchmark<D>(atoi(args[1]), atoi(args[2]), atoi(args[3]), tree.get_max_entry_num(), dimension);
+		}
+		return true;
+	}
+	else if (strcmp(args[0], "fl") == 0) { // flush the node buffers.
+		tree.flush();
+		return true;
+	}
+	else if (strcmp(args[0], "cp") == 0) { // compaction.
+		int purged = tree.compact();
+		cout << purged << " tombstone(s) removed.\n";
+		return true;
+	}
+	else if (strcmp(args[0], "rd") == 0) { // random deletion.
+		if (num_arg != 3) {
+			sprintf(msg, "Wrong number of arguments for command 'rd'");
+			error(msg);
+		}
+		else {
+			srand(atoi(args[1]));
+			int num = atoi(args[2]);
+			int succeed = 0;
+			for (int i = 0; i < num; i++) {
+				vector<int> coordinate;
+				for (int j = 0; j < dimension; j++)
+				{
+					int coord = rand() % DOMAIN_SIZE;
+					coordinate.push_back(coord);
+				}
+				int dummy = rand(); // to be compatible with ``ri''.
+				if (tree.del(coordinate)) {
+					succeed++;
+				}
+			}
+			cout << succeed << " out of " << num << " deletion(s) suceeded.\n";
+		}
+		return true;
+	}
+	else if (strcmp(args[0], "rdb") == 0) { // random deletions in one batch.
+		if (num_arg != 3) {
+			sprintf(msg, "Wrong number of arguments for command 'rdb'");
+			error(msg);
+		}
+		else {
+			// the same keys as ``rd'' with the same seed.
+			srand(atoi(args[1]));
+			int num = atoi(args[2]);
+			vector<vector<int> > keys(num);
+			for (int i = 0; i < num; i++) {
+				for (int j = 0; j < dimension; j++)
+				{
+					int coord = rand() % DOMAIN_SIZE;
+					keys[i].push_back(coord);
+				}
+				rand(); // to be compatible with ``ri''.
+			}
+
+			chrono::steady_clock::time_point start = chrono::steady_clock::now();
+			int succeed = tree.delete_batch(keys);
+			double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+			cout << succeed << " out of " << num << " deletion(s) suceeded.\n";
+			cout << "Delete time: " << ms << " ms\n";
+		}
+		return true;
+	}
+	else if (strcmp(args[0], "qr") == 0) { // range query.
+		if (num_arg != 1 + dimension * 2) {
+			sprintf(msg, "Wrong number of arguments for command 'qr'");
+			error(msg);
+		}
+		else {
+			vector<int> lowest;
+			vector<int> highest;
+			for (int i = 0; i < dimension; i++)
+			{
+				lowest.push_back(atoi(args[1 + i*2]));			
+				highest.push_back(atoi(args[2 + i*2]));
+			}
+
+			BoundingBox<D> mbr(lowest, highest);
+
+			int result_count = 0;
+			int node_travelled = 0;
+			tree.query_range(mbr, result_count, node_travelled);
+			cout << "Number of results: " << result_count << endl;
+			cout << "Number of nodes visited: " << node_travelled << endl;
+		}
+		return true;
+	}
+	else if (strcmp(args[0], "qrl") == 0) { // range query listing the records.
+		if (num_arg != 1 + dimension * 2) {
+			sprintf(msg, "Wrong number of arguments for command 'qrl'");
+			error(msg);
+		}
+		else {
+			vector<int> lowest;
+			vector<int> highest;
+			for (int i = 0; i < dimension; i++)
+			{
+				lowest.push_back(atoi(args[1 + i*2]));
+				highest.push_back(atoi(args[2 + i*2]));
+			}
+
+			BoundingBox<D> mbr(lowest, highest);
+
+			vector<Entry<D> > results;
+			int node_travelled = 0;
+			tree.query_range(mbr, results, node_travelled);
+			for (size_t i = 0; i < results.size(); i++)
+				print_record(results[i]);
+			cout << "Number of results: " << results.size() << endl;
+			cout << "Number of nodes visited: " << node_travelled << endl;
+		}
+		return true;
+	}
+	else if (strcmp(args[0], "qk") == 0) { // k nearest neighbour query.
+		if (num_arg != 2 + dimension) {
+			sprintf(msg, "Wrong number of arguments for command 'qk'");
+			error(msg);
+		}
+		else {
+			vector<int> coordinate;
+			for (int i = 0; i < dimension; i++)
+			{
+				coordinate.push_back(atoi(args[i + 1]));
+			}
+			int k = atoi(args[dimension + 1]);
+
+			vector<Entry<D> > results;
+			int node_travelled = 0;
+			tree.query_knn(coordinate, k, results, node_travelled);
+			for (size_t i = 0; i < results.size(); i++)
+				print_record(results[i]);
+			cout << "Number of results: " << results.size() << endl;
+			cout << "Number of nodes visited: " << node_travelled << endl;
+		}
+		return true;
+	}
+	else if (strcmp(args[0], "qp") == 0) { // point query.
+		if (num_arg != 1 + dimension) {
+			sprintf(msg, "Wrong number of arguments for command 'qp'");
+			error(msg);
+		}
+		else {
+			Entry<D> result;
+
+			vector<int> coordinate;
+
+			for (int i = 0; i < dimension; i++)
+			{
+				coordinate.push_back(atoi(args[i + 1]));
+			}
+
+			if (tree.query_point(coordinate, result)) {
+				print_record(result);
+			}
+			else {
+				cout << "Record not found.\n";
+			}
+		}
+		return true;
+	}
+	else if (strcmp(args[0], "s") == 0) { // statistics.
+		tree.stat();
+		return true;
+	}
+	else if (strcmp(args[0], "p") == 0) { // print tree.
+		tree.print_tree();
+		return true;
+	}
+	else if (strcmp(args[0], "h") == 0) { // print help menu.
+		help();
+		return true;
+	}
+	else if (strcmp(args[0], "x") == 0) { // exit
+		return false;
+	}
+	else {
+		sprintf(msg, "Invalid command '%s'.\nType 'h' to print the help menu.", args[0]);
+		error(msg);
+		return true;
+	}
+}
+
+
+
+template <int D>
+void run(const char* cmd_file, int max_entry_num, int dimension, InsertMode mode, SplitMethod split, bool locator,
+	int buffer_size, double lazy_ratio)
+{
+	RTree<D> tree(max_entry_num, dimension, mode, split);
+	tree.set_locator(locator);
+	tree.set_buffer_size(buffer_size);
+	if (lazy_ratio >= 0)
+		tree.set_lazy_delete(true, lazy_ratio);
+
+	// Processing input commands.
+	char command[MAX_CMD_LEN];
+	if (cmd_file != NULL) {
+		ifstream fin(cmd_file);
+		while (fin.getline(command, MAX_CMD_LEN)) {
+			//cout << command << endl;
+			if (! process(command, tree, dimension))
+				break;
+		}
+	}
+	else {
+		while (true) {
+			cout << ">> ";
+			cin.getline(command, MAX_CMD_LEN);
+			if (! process(command, tree, dimension))
+				break;
+		}
+	}
+}
+
+
+int main(int argc, char *argv[])
+{//argc also counts the argv[0] that is the name of the program
+	
+	if (argc < 3) {
+		cerr << "Usage: " << argv[0] << " Max_#entries_in_a_node Dimensionality_of_Rtree\" [file_containing_commmands] [-rstar] [-locator]\n";
+		cerr << "     [-split linear|quadratic|rstar|exhaustive] [-buffer records_per_node_buffer]\n";
+		cerr << "     [-lazy tombstone_ratio_to_compact_at, 0 for never].\n";
+		return 0;
+	}
+
+	// Create an R-tree.
+	int max_entry_num = atoi(argv[1]);
+	if (max_entry_num < 2) {
+		cerr << "Number of entries should be an integer > 2.\n";
+		return 0;
+	}
+	int dimension = atoi(argv[2]);
+	// optional arguments: the command file and the insertion algorithm.
+	const char* cmd_file = NULL;
+	InsertMode mode = GUTTMAN_INSERT;
+	const char* split = NULL;
+	bool locator = false;
+	int buffer_size = 0;
+	double lazy_ratio = -1; // no lazy deletion
+	for (int i = 3; i < argc; i++) {
+		if (strcmp(argv[i], "-rstar") == 0)
+			mode = RSTAR_INSERT;
+		else if (strcmp(argv[i], "-locator") == 0)
+			locator = true;
+		else if (strcmp(argv[i], "-split") == 0 && i + 1 < argc)
+			split = argv[++i];
+		else if (strcmp(argv[i], "-buffer") == 0 && i + 1 < argc)
+			buffer_size = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-lazy") == 0 && i + 1 < argc)
+			lazy_ratio = atof(argv[++i]);
+		else
+			cmd_file = argv[i];
+	}
+	// the split method follows the insertion algorithm unless given.
+	SplitMethod split_method = mode == RSTAR_INSERT ? RSTAR_SPLIT : LINEAR_SPLIT;
+	if (split != NULL) {
+		if (strcmp(split, "linear") == 0)
+			split_method = LINEAR_SPLIT;
+		else if (strcmp(split, "quadratic") == 0)
+			split_method = QUADRATIC_SPLIT;
+		else if (strcmp(split, "rstar") == 0)
+			split_method = RSTAR_SPLIT;
+		else if (strcmp(split, "exhaustive") == 0)
+			split_method = EXHAUSTIVE_SPLIT;
+		else {
+			cerr << "Unknown split method " << split << ".\n";
+			return 0;
+		}
+	}
+	// 2-d and 3-d trees keep their coordinates inline, others fall back to a runtime dimension.
+	if (dimension == 2)
+		run<2>(cmd_file, max_entry_num, dimension, mode, split_method, locator, buffer_size, lazy_ratio);
+	else if (dimension == 3)
+		run<3>(cmd_file, max_entry_num, dimension, mode, split_method, locator, buffer_size, lazy_ratio);
+	else
+		run<DYNAMIC_DIM>(cmd_file, max_entry_num, dimension, mode, split_method, locator, buffer_size, lazy_ratio);
+
+	return 0;
+}
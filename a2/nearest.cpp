@@ -0,0 +1,94 @@
+#include <cmath>
+#include "nearest.h"
+
+//======================== NearestIterator implementation ==========================================
+
+//
+// Order for the max-heap of priority_queue: the nearest candidate comes out first,
+// and records come out before nodes at the same distance.
+//
+template <int D>
+bool NearestIterator<D>::Candidate::operator<(const Candidate& rhs) const
+{
+	if (dist != rhs.dist)
+		return dist > rhs.dist;
+	return node != NULL && rhs.node == NULL;
+}
+
+template <int D>
+NearestIterator<D>::NearestIterator(const RTree<D>& tree, const vector<int>& coordinate)
+	: tree(tree), point(coordinate), node_travelled(0)
+{
+	if ((int)coordinate.size() != tree.dimension)
+	{
+		cerr << "R-tree dimensionality inconsistency\n";
+		point.resize(tree.dimension);
+	}
+	slot = tree.pin();
+	Candidate c;
+	c.dist = 0;
+	c.node = tree.snapshot_root();
+	c.entry = NULL;
+	queue.push(c);
+}
+
+template <int D>
+NearestIterator<D>::~NearestIterator()
+{
+	tree.unpin(slot);
+}
+
+//
+// Push the children of ``node'' into the queue.
+//
+template <int D>
+void NearestIterator<D>::expand(const RTNode<D>* node)
+{
+	node_travelled++;
+	for (size_t i = 0; i < node->buffer.size(); i++) {
+		Candidate c;
+		c.dist = node->buffer[i].get_mbr().get_mindist(&point[0]);
+		c.node = NULL;
+		c.entry = &node->buffer[i];
+		queue.push(c);
+	}
+	for (int i = 0; i < node->entry_num; i++) {
+		if (node->level == 0 && node->entries[i].is_deleted())
+			continue;
+		Candidate c;
+		c.dist = node->entries[i].get_mbr().get_mindist(&point[0]);
+		c.node = node->level == 0 ? NULL : node->entries[i].get_ptr();
+		c.entry = &node->entries[i];
+		queue.push(c);
+	}
+}
+
+//
+// Return the next nearest record in ``result'' and its euclidean distance in ``distance''.
+//
+template <int D>
+bool NearestIterator<D>::next(Entry<D>& result, double& distance)
+{
+	while (!queue.empty()) {
+		Candidate c = queue.top();
+		queue.pop();
+		if (c.node == NULL) {
+			result = *c.entry;
+			distance = sqrt(c.dist);
+			return true;
+		}
+		expand(c.node);
+	}
+	return false;
+}
+
+template <int D>
+int NearestIterator<D>::get_node_travelled() const
+{
+	return node_travelled;
+}
+
+
+template class NearestIterator<2>;
+template class NearestIterator<3>;
+template class NearestIterator<DYNAMIC_DIM>;
@@ -0,0 +1,46 @@
+#ifndef NEAREST_H
+#define NEAREST_H
+
+#include <queue>
+#include "rtree.h"
+
+//
+// Best-first nearest neighbour search. Nodes and records wait in one priority
+// queue ordered by MINDIST to the query point, so next() only expands the nodes
+// that are closer than the record it returns.
+// The iterator reads the tree in place: do not modify the tree while using it,
+// unless in snapshot mode, where it reads the snapshot published when it was created.
+//
+template <int D>
+class NearestIterator {
+	public:
+		NearestIterator(const RTree<D>& tree, const vector<int>& coordinate);
+		~NearestIterator();
+
+		bool next(Entry<D>& result, double& distance); // false when no record is left
+		int get_node_travelled() const;
+
+	private:
+		struct Candidate {
+			double dist;				// squared MINDIST to the query point
+			const RTNode<D>* node;		// node to expand, or NULL for a record
+			const Entry<D>* entry;		// valid only if node is NULL
+
+			bool operator<(const Candidate& rhs) const;
+		};
+
+		void expand(const RTNode<D>* node);
+
+	private:
+		NearestIterator(const NearestIterator& other);	// not copyable: it pins a snapshot
+		NearestIterator& operator=(const NearestIterator& other);
+
+	private:
+		const RTree<D>& tree;
+		int slot;	// snapshot pinned by the iterator
+		vector<int> point;
+		priority_queue<Candidate> queue;
+		int node_travelled;
+};
+
+#endif
@@ -0,0 +1,103 @@
+#include <new>
+#include "nodepool.h"
+
+template <int D>
+NodePool<D>::NodePool(int node_size, int dim)
+{
+	this->node_size = node_size;
+	this->dim = D != DYNAMIC_DIM ? D : dim;
+	soa_len = RTNode<D>::soa_size(node_size, this->dim);
+	node_cnt = 0;
+	version = 0;
+}
+
+template <int D>
+NodePool<D>::~NodePool()
+{
+	for (int i = 0; i < node_cnt; i++)
+		slabs[i / SLAB_NODES][i % SLAB_NODES].~RTNode<D>();
+	for (size_t i = 0; i < slabs.size(); i++) {
+		::operator delete(slabs[i]);
+		delete []entry_blocks[i];
+		delete []soa_blocks[i];
+	}
+}
+
+//
+// Add a slab and push its nodes on the free list, first node on top.
+//
+template <int D>
+void NodePool<D>::add_slab()
+{
+	RTNode<D>* slab = (RTNode<D>*)::operator new(sizeof(RTNode<D>) * SLAB_NODES);
+	Entry<D>* entries = new Entry<D>[node_size * SLAB_NODES];
+	int* soa = soa_len > 0 ? new int[soa_len * SLAB_NODES]() : NULL;
+	slabs.push_back(slab);
+	entry_blocks.push_back(entries);
+	soa_blocks.push_back(soa);
+
+	for (int i = SLAB_NODES - 1; i >= 0; i--) {
+		RTNode<D>* node = new (slab + i) RTNode<D>(0, node_size, dim, entries + node_size * i,
+			soa != NULL ? soa + soa_len * i : NULL);
+		free_list.push_back(node);
+	}
+	node_cnt += SLAB_NODES;
+}
+
+template <int D>
+RTNode<D>* NodePool<D>::alloc(int level)
+{
+	lock_guard<mutex> guard(lock);
+	if (free_list.empty())
+		add_slab();
+	RTNode<D>* node = free_list.back();
+	free_list.pop_back();
+	node->entry_num = 0;
+	node->level = level;
+	node->buffer.clear();
+	node->version = version;
+	node->right = NULL;
+	node->nsn = 0;
+	return node;
+}
+
+template <int D>
+void NodePool<D>::release(RTNode<D>* node)
+{
+	lock_guard<mutex> guard(lock);
+	free_list.push_back(node);
+}
+
+template <int D>
+void NodePool<D>::release_tree(RTNode<D>* node)
+{
+	if (node->level != 0) {
+		for (int i = 0; i < node->entry_num; i++)
+			release_tree(node->entries[i].get_ptr());
+	}
+	release(node);
+}
+
+template <int D>
+int NodePool<D>::get_node_num() const
+{
+	return node_cnt - free_list.size();
+}
+
+template <int D>
+unsigned long long NodePool<D>::get_version() const
+{
+	return version;
+}
+
+template <int D>
+void NodePool<D>::next_version()
+{
+	lock_guard<mutex> guard(lock);
+	version++;
+}
+
+
+template class NodePool<2>;
+template class NodePool<3>;
+template class NodePool<DYNAMIC_DIM>;
@@ -0,0 +1,49 @@
+#ifndef NODEPOOL_H
+#define NODEPOOL_H
+
+#include <mutex>
+#include <vector>
+#include "rtnode.h"
+
+using namespace std;
+
+//
+// Node arena of an R-tree: nodes of one capacity are carved out of slabs of
+// SLAB_NODES nodes, whose entry and SoA arrays are single blocks as well.
+// Released nodes go to a free list and are handed out again by alloc().
+// The pool owns every node it creates; they are destroyed with the pool.
+//
+template <int D>
+class NodePool {
+	public:
+		NodePool(int node_size, int dim);
+		~NodePool();
+
+		RTNode<D>* alloc(int level);
+		void release(RTNode<D>* node); // the node only, not its children
+		void release_tree(RTNode<D>* node); // the node and its subtree
+		int get_node_num() const; // nodes handed out and not released
+		// alloc() stamps each node with the current version: a snapshot can tell
+		// the nodes created since it was taken.
+		unsigned long long get_version() const;
+		void next_version();
+
+	private:
+		void add_slab();
+
+	private:
+		static const int SLAB_NODES = 64;
+
+		int node_size;
+		int dim;
+		int soa_len;				// ints of SoA storage per node
+		vector<RTNode<D>*> slabs;	// raw storage of SLAB_NODES nodes each
+		vector<Entry<D>*> entry_blocks;
+		vector<int*> soa_blocks;
+		vector<RTNode<D>*> free_list;
+		int node_cnt;				// nodes constructed in the slabs
+		unsigned long long version;
+		mutex lock;					// bulk loading allocates from several threads
+};
+
+#endif
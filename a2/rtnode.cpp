@@ -1,86 +1,316 @@
-#include "rtnode.h"
-
-//======================== Entry implementation =====================================================
-
-Entry::Entry():mbr() {
-	this->rid = -1;
-	this->ptr = NULL;
-}
-
-Entry::Entry(const BoundingBox& thatMBR, const int rid):mbr(thatMBR) {
-	this->rid = rid;
-	this->ptr = NULL;
-}
-
-Entry::~Entry() {
-	this->ptr = NULL;
-}
-
-const BoundingBox& Entry::get_mbr() const {
-	return this->mbr;
-}	
-
-
-RTNode* Entry::get_ptr() const {
-	return this->ptr;
-}
-
-int Entry::get_rid() const { 
-	return this->rid;
-}
-
-
-void Entry::set_mbr(const BoundingBox& thatMBR) {
-	this->mbr.set_boundingbox(thatMBR);
-}
-
-void Entry::set_ptr(RTNode* ptr) {
-	this->ptr = ptr;
-}
-
-void Entry::print() {
-	this->mbr.print();
-	cout << this->rid << endl;
-	cout << this->ptr << endl;
-}
-
-//======================== RTNode implementation ==============================================
-
-RTNode::RTNode(int lev, int s)
-{
-	entry_num = 0;
-	entries = new Entry[s];
-	level = lev;
-	size = s;
-}
-
-RTNode::RTNode(const RTNode& other)
-{
-	entries = new Entry[other.size];
-	*this = other;
-}
-
-RTNode& RTNode::operator=(const RTNode& other)
-{
-	if (&other != this) { // check the same reference first!
-		entry_num = other.entry_num;
-		level = other.level;
-		size = other.size;
-		for (int i = 0; i < entry_num; i++)
-			entries[i] = other.entries[i];
-	}
-	return *this;
-}
-
-
-RTNode::~RTNode()
-{
-	if (level != 0) {
-		for (int i = 0; i < entry_num; i++) {
-			delete entries[i].get_ptr();
-			entries[i].set_ptr(NULL);
-		}
-	}
-	delete []entries;
-	entries = NULL;
-}
\ No newline at end of file
+#include "rtnode.h"
+#if defined(RTREE_SOA) && defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+//======================== Entry implementation =====================================================
+
+template <int D>
+Entry<D>::Entry():mbr() {
+	this->rid = -1;
+	this->ptr = NULL;
+	this->deleted = false;
+}
+
+template <int D>
+Entry<D>::Entry(const BoundingBox<D>& thatMBR, const int rid):mbr(thatMBR) {
+	this->rid = rid;
+	this->ptr = NULL;
+	this->deleted = false;
+}
+
+template <int D>
+Entry<D>::~Entry() {
+	this->ptr = NULL;
+}
+
+template <int D>
+const BoundingBox<D>& Entry<D>::get_mbr() const {
+	return this->mbr;
+}	
+
+
+template <int D>
+RTNode<D>* Entry<D>::get_ptr() const {
+	return this->ptr;
+}
+
+template <int D>
+int Entry<D>::get_rid() const { 
+	return this->rid;
+}
+
+template <int D>
+bool Entry<D>::is_deleted() const {
+	return this->deleted;
+}
+
+
+template <int D>
+void Entry<D>::set_mbr(const BoundingBox<D>& thatMBR) {
+	this->mbr.set_boundingbox(thatMBR);
+}
+
+template <int D>
+void Entry<D>::set_ptr(RTNode<D>* ptr) {
+	this->ptr = ptr;
+}
+
+template <int D>
+void Entry<D>::set_rid(int rid) {
+	this->rid = rid;
+}
+
+template <int D>
+void Entry<D>::set_deleted(bool deleted) {
+	this->deleted = deleted;
+}
+
+template <int D>
+void Entry<D>::print() {
+	this->mbr.print();
+	cout << this->rid << endl;
+	cout << this->ptr << endl;
+}
+
+//======================== RTNode implementation ==============================================
+
+#ifdef RTREE_SOA
+#ifdef __SSE2__
+//
+// Test ``n'' SoA entries starting from ``base'' against the box (low, high), 4 entries per step.
+// soa_cap is a multiple of 8, so the loads never run past the arrays.
+//
+static unsigned long long soa_intersect_sse(const int* soa, int cap, int dim, int base, int n, const int* low, const int* high)
+{
+	unsigned long long mask = 0;
+	for (int i = 0; i < n; i += 4) {
+		__m128i hit = _mm_set1_epi32(-1);
+		for (int d = 0; d < dim; d++) {
+			__m128i lo = _mm_loadu_si128((const __m128i*)(soa + d * cap + base + i));
+			__m128i hi = _mm_loadu_si128((const __m128i*)(soa + (dim + d) * cap + base + i));
+			// an entry misses if its low side is above the query or its high side below it.
+			__m128i miss = _mm_or_si128(_mm_cmpgt_epi32(lo, _mm_set1_epi32(high[d])),
+				_mm_cmpgt_epi32(_mm_set1_epi32(low[d]), hi));
+			hit = _mm_andnot_si128(miss, hit);
+		}
+		mask |= (unsigned long long)_mm_movemask_ps(_mm_castsi128_ps(hit)) << i;
+	}
+	return n == 64 ? mask : mask & ((1ULL << n) - 1);
+}
+
+//
+// Same test, 8 entries per step. Only called when the CPU reports AVX2.
+//
+__attribute__((target("avx2")))
+static unsigned long long soa_intersect_avx2(const int* soa, int cap, int dim, int base, int n, const int* low, const int* high)
+{
+	unsigned long long mask = 0;
+	for (int i = 0; i < n; i += 8) {
+		__m256i hit = _mm256_set1_epi32(-1);
+		for (int d = 0; d < dim; d++) {
+			__m256i lo = _mm256_loadu_si256((const __m256i*)(soa + d * cap + base + i));
+			__m256i hi = _mm256_loadu_si256((const __m256i*)(soa + (dim + d) * cap + base + i));
+			__m256i miss = _mm256_or_si256(_mm256_cmpgt_epi32(lo, _mm256_set1_epi32(high[d])),
+				_mm256_cmpgt_epi32(_mm256_set1_epi32(low[d]), hi));
+			hit = _mm256_andnot_si256(miss, hit);
+		}
+		mask |= (unsigned long long)(unsigned int)_mm256_movemask_ps(_mm256_castsi256_ps(hit)) << i;
+	}
+	return n == 64 ? mask : mask & ((1ULL << n) - 1);
+}
+#else
+//
+// Test ``n'' SoA entries starting from ``base'' against the box (low, high), one at a time.
+//
+static unsigned long long soa_intersect_scalar(const int* soa, int cap, int dim, int base, int n, const int* low, const int* high)
+{
+	unsigned long long mask = 0;
+	for (int i = 0; i < n; i++) {
+		bool hit = true;
+		for (int d = 0; d < dim && hit; d++) {
+			hit = soa[d * cap + base + i] <= high[d] && soa[(dim + d) * cap + base + i] >= low[d];
+		}
+		if (hit)
+			mask |= 1ULL << i;
+	}
+	return mask;
+}
+#endif
+#endif
+
+template <int D>
+RTNode<D>::RTNode(int lev, int s, int d)
+{
+	entry_num = 0;
+	entries = new Entry<D>[s];
+	level = lev;
+	size = s;
+	dim = D != DYNAMIC_DIM ? D : d;
+	version = 0;
+	right = NULL;
+	nsn = 0;
+	pooled = false;
+	alloc_soa();
+}
+
+template <int D>
+RTNode<D>::RTNode(int lev, int s, int d, Entry<D>* entry_block, int* soa_block)
+{
+	entry_num = 0;
+	entries = entry_block;
+	level = lev;
+	size = s;
+	dim = D != DYNAMIC_DIM ? D : d;
+	version = 0;
+	right = NULL;
+	nsn = 0;
+	pooled = true;
+#ifdef RTREE_SOA
+	soa_cap = (size + 7) / 8 * 8;
+	soa = soa_block;
+#endif
+}
+
+template <int D>
+RTNode<D>::RTNode(const RTNode& other)
+{
+	entries = new Entry<D>[other.size];
+	version = other.version;
+	right = NULL;
+	nsn = 0;
+	pooled = false;
+	size = other.size;
+	dim = other.dim;
+	alloc_soa();
+	*this = other;
+}
+
+template <int D>
+RTNode<D>& RTNode<D>::operator=(const RTNode& other)
+{
+	if (&other != this) { // check the same reference first!
+		entry_num = other.entry_num;
+		level = other.level;
+		size = other.size;
+		for (int i = 0; i < entry_num; i++)
+			set_entry(i, other.entries[i]);
+	}
+	return *this;
+}
+
+
+template <int D>
+RTNode<D>::~RTNode()
+{
+	if (pooled)
+		return;
+	if (level != 0) {
+		for (int i = 0; i < entry_num; i++) {
+			delete entries[i].get_ptr();
+			entries[i].set_ptr(NULL);
+		}
+	}
+	delete []entries;
+	entries = NULL;
+#ifdef RTREE_SOA
+	delete []soa;
+	soa = NULL;
+#endif
+}
+
+template <int D>
+void RTNode<D>::alloc_soa()
+{
+#ifdef RTREE_SOA
+	soa_cap = (size + 7) / 8 * 8;
+	soa = new int[soa_size(size, dim)]();
+#endif
+}
+
+template <int D>
+int RTNode<D>::soa_size(int size, int dim)
+{
+#ifdef RTREE_SOA
+	return 2 * dim * ((size + 7) / 8 * 8);
+#else
+	return 0;
+#endif
+}
+
+template <int D>
+void RTNode<D>::sync_soa(int idx)
+{
+#ifdef RTREE_SOA
+	const BoundingBox<D>& mbr = entries[idx].get_mbr();
+	for (int d = 0; d < dim; d++) {
+		soa[d * soa_cap + idx] = mbr.get_lowestValue_at(d);
+		soa[(dim + d) * soa_cap + idx] = mbr.get_highestValue_at(d);
+	}
+#endif
+}
+
+template <int D>
+void RTNode<D>::set_entry(int idx, const Entry<D>& e)
+{
+	entries[idx] = e;
+	sync_soa(idx);
+}
+
+template <int D>
+void RTNode<D>::set_entry_mbr(int idx, const BoundingBox<D>& mbr)
+{
+	entries[idx].set_mbr(mbr);
+	sync_soa(idx);
+}
+
+template <int D>
+void RTNode<D>::add_entry(const Entry<D>& e)
+{
+	set_entry(entry_num, e);
+	entry_num++;
+}
+
+template <int D>
+void RTNode<D>::remove_entry(int idx)
+{
+	int last = entry_num - 1;
+	Entry<D> temp = entries[idx];
+	set_entry(idx, entries[last]);
+	set_entry(last, temp);
+	entry_num--;
+}
+
+template <int D>
+unsigned long long RTNode<D>::intersect_mask(const BoundingBox<D>& mbr, int base) const
+{
+	int n = entry_num - base < 64 ? entry_num - base : 64;
+	if (n <= 0)
+		return 0;
+#ifdef RTREE_SOA
+#ifdef __SSE2__
+	static const bool has_avx2 = __builtin_cpu_supports("avx2");
+	if (has_avx2)
+		return soa_intersect_avx2(soa, soa_cap, dim, base, n, mbr.get_lowest(), mbr.get_highest());
+	return soa_intersect_sse(soa, soa_cap, dim, base, n, mbr.get_lowest(), mbr.get_highest());
+#else
+	return soa_intersect_scalar(soa, soa_cap, dim, base, n, mbr.get_lowest(), mbr.get_highest());
+#endif
+#else
+	unsigned long long mask = 0;
+	for (int i = 0; i < n; i++) {
+		if (entries[base + i].get_mbr().is_intersected(mbr))
+			mask |= 1ULL << i;
+	}
+	return mask;
+#endif
+}
+
+
+template class Entry<2>;
+template class Entry<3>;
+template class Entry<DYNAMIC_DIM>;
+
+template class RTNode<2>;
+template class RTNode<3>;
+template class RTNode<DYNAMIC_DIM>;
@@ -1,39 +1,83 @@
-#include "boundingbox.h"
+#ifndef RTNODE_H
+#define RTNODE_H
 
+#include <shared_mutex>
+ #include "boundingbox.h"
 
-class RTNode;
 
+template <int D> class RTNode;
+
+template <int D>
 class Entry {
 private:
-	BoundingBox mbr;
-	RTNode* ptr;		//point to the node this entry represents, valid only if this is a non-leaf node entry.
+	BoundingBox<D> mbr;
+	RTNode<D>* ptr;		//point to the node this entry represents, valid only if this is a non-leaf node entry.
 	int rid;			// valid only if this is a leaf node entry.
+	bool deleted;		// tombstone of a lazily deleted record, valid only if this is a leaf node entry.
 	
 public:
 	Entry();
-	Entry(const BoundingBox& thatMBR, const int rid);
+	Entry(const BoundingBox<D>& thatMBR, const int rid);
 	~Entry();
 	//getters
-	const BoundingBox& get_mbr() const;
-	RTNode* get_ptr() const;
+	const BoundingBox<D>& get_mbr() const;
+	RTNode<D>* get_ptr() const;
 	int get_rid() const;
+	bool is_deleted() const;
 	//setters
-	void set_mbr(const BoundingBox& thatMBR);
-	void set_ptr(RTNode* ptr);
+	void set_mbr(const BoundingBox<D>& thatMBR);
+	void set_ptr(RTNode<D>* ptr);
+	void set_rid(int rid);
+	void set_deleted(bool deleted);
 
 	void print();
 };
 
+template <int D>
 class RTNode { // a list of entries
 	public:
-		RTNode(int lev, int size);        
+		RTNode(int lev, int size, int dim);
+		RTNode(int lev, int size, int dim, Entry<D>* entry_block, int* soa_block); // storage owned by a NodePool
 		RTNode(const RTNode& other);
 		RTNode& operator=(const RTNode& other);
 		~RTNode();
 
+		// entries must be modified through these so that the SoA copy stays in sync.
+		void set_entry(int idx, const Entry<D>& e);
+		void set_entry_mbr(int idx, const BoundingBox<D>& mbr);
+		void add_entry(const Entry<D>& e);
+		void remove_entry(int idx); // move entries[idx] right behind the last entry
+		// bit i is set iff entries[base + i] intersects mbr, for up to 64 entries from base.
+		unsigned long long intersect_mask(const BoundingBox<D>& mbr, int base) const;
+		static int soa_size(int size, int dim); // ints of SoA storage for a node of ``size'' entries
+
+	private:
+		void alloc_soa();
+		void sync_soa(int idx);
+
 	public:
 		int entry_num;
-		Entry* entries;
+		Entry<D>* entries;
 		int level;
 		int size;
+		int dim;
+		vector<Entry<D> > buffer;	// buffered insertion: records on their way down to the leaves
+		BoundingBox<D> buffer_mbr;	// MBR of the buffer, if it is not empty
+		unsigned long long version;	// version of the NodePool when the node was handed out
+		// latched insertion (R-link tree): the node split off this one last, and the value of
+		// the split counter of the tree when this one was split, or it was split off.
+		RTNode<D>* right;
+		unsigned long long nsn;
+		mutable shared_mutex latch;
+
+	private:
+		bool pooled;	// arrays and children belong to a NodePool
+#ifdef RTREE_SOA
+		// per-dimension copies of the entry MBRs: lowest values of dimension d at
+		// soa[d * soa_cap], highest values at soa[(dim + d) * soa_cap].
+		int* soa;
+		int soa_cap;
+#endif
 };
+
+#endif
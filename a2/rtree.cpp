@@ -1,750 +1,3789 @@
-/* Implementations of R tree */
-#include <cmath>
-#include "rtree.h"
-
-
-const double EPSILON = 1E-10;
-
-RTree::RTree(int entry_num)
-{
-	max_entry_num = entry_num;
-	dimension = 2;//by default
-	root = new RTNode(0, entry_num);
-}
-
-RTree::RTree(int entry_num, int dim)
-{
-	max_entry_num = entry_num;
-	dimension = dim;//by default
-	root = new RTNode(0, entry_num);
-}
-
-RTree::~RTree()
-{
-	delete root;
-	root = NULL;
-}
-
-
-//
-// Check whether two entries are the same.
-// Return true if same, otherwise false.
-//
-bool RTree::same_entry(const Entry& e1, const Entry& e2)
-{
-	const BoundingBox& mbr1 = e1.get_mbr();
-	const BoundingBox& mbr2 = e2.get_mbr();
-	
-	return mbr1.is_equal(mbr2);
-}
-
-
-//
-// Check whether two boundingboxs overlap.
-// Return true if so, otherwise false.
-//
-bool RTree::overlap(const BoundingBox box1, const BoundingBox box2)
-{
-	return box1.is_intersected(box2);
-}
-
-
-//
-// Update the current MBR ``mbr'' with the merging result of ``mbr'' and ``new_mbr''
-//
-void RTree::update_mbr(BoundingBox& mbr, const BoundingBox& new_mbr)
-{
-	mbr.group_with(new_mbr);
-}
-
-
-//
-// Calculate the MBR of a set of entries, of size ``len''.
-
-BoundingBox RTree::get_mbr(Entry* entry_list, int len)
-{
-	BoundingBox mbr(entry_list[0].get_mbr());
-	for (int i = 1; i < len; i++) {        
-		mbr.group_with(entry_list[i].get_mbr());
-	}
-	return mbr;
-}
-
-
-//
-// Return the area of a boundingbox ``mbr''.
-//
-int RTree::area(const BoundingBox& mbr)
-{
-	return mbr.get_area();
-}
-
-
-//
-// Swap two entries: entry_list[id1] and entry_list[id2].
-//
-void RTree::swap_entry(Entry* entry_list, int id1, int id2)
-{
-	Entry temp = entry_list[id1];
-	entry_list[id1] = entry_list[id2];
-	entry_list[id2] = temp;
-}
-
-
-//
-// Calculate the area enlarged by add the new entry to the existing MBR.
-//
-int RTree::area_inc(const BoundingBox& mbr, const BoundingBox& entry_mbr)
-{
-	BoundingBox new_mbr(mbr);
-	new_mbr.group_with(entry_mbr);
-	return area(new_mbr) - area(mbr);
-}
-
-//
-// Linear Pick Seeds algorithm for Lienar Cost Algorithm.
-//
-void RTree::linear_pick_seeds(Entry* entry_list, int len, int& m1, int& m2)
-{
-	int iminx = 0, imaxx = 0, iminy = 0, imaxy = 0;    
-	int dim = entry_list[0].get_mbr().get_dim();
-
-	//extreme pairs for each dimension
-	//for a pair, first element is the entry with highest low side, second is the entry with lowest high side
-	vector<pair<int,int> > extremePairs;
-	//initialize entreme pairs
-	for (int i = 0; i < dim; i++)
-	{
-		pair<int, int> extremePair(0, 0);//the first entry by default
-		extremePairs.push_back(extremePair);
-	}
-	// pick the two entries with the largest gap on each dimension
-	//for every entry
-	for (int i = 1; i < len; i++) {
-		//for every dimension
-		for (int j = 0; j < dim; j++)
-		{
-			pair<int, int> extremePair = extremePairs[j];
-			BoundingBox ithMBR = entry_list[i].get_mbr();
-
-			//get highest low side on j-th dimension
-			//the MBR of entry that has highest low side on dimension j
-			BoundingBox highestLowEntryMBR = entry_list[extremePair.first].get_mbr();
-			if (ithMBR.get_lowestValue_at(j) > highestLowEntryMBR.get_lowestValue_at(j)) {
-				extremePairs[j].first = i;
-			}
-			else if (ithMBR.get_lowestValue_at(j) == highestLowEntryMBR.get_lowestValue_at(j)) {
-				if (tie_breaking(ithMBR, highestLowEntryMBR)) {
-					extremePairs[j].first = i;
-				}
-			}
-
-			//get lowest high side on j-th dimension
-			BoundingBox lowestHighEntryMBR = entry_list[extremePair.second].get_mbr();
-			if (ithMBR.get_highestValue_at(j) < lowestHighEntryMBR.get_highestValue_at(j))
-
-			{
-				extremePairs[j].second = i;
-			}
-			else if (ithMBR.get_highestValue_at(j) == lowestHighEntryMBR.get_highestValue_at(j))
-			{
-				if (tie_breaking(ithMBR, lowestHighEntryMBR)) {
-					extremePairs[j].second = i;
-				}
-			}
-		}
-
-	}
-	BoundingBox box = get_mbr(entry_list, len);
-	
-	//for each dimension, find the greatest normalized separation and store the respective pair in m1 and m2
-	//init
-	double greatestNormalizedSeparation = -1; // the normal value of this should be >= 0
-	m1 = -1;
-	m2 = -1;
-	for (int j = 0; j < dim; j++)
-	{
-		double normalizedJdimSeparation = 0;
-		double delta = box.get_highestValue_at(j) - box.get_lowestValue_at(j);
-
-		pair<int, int> extremePair = extremePairs[j];
-		if (delta != 0)
-		{
-			normalizedJdimSeparation = 
-				abs(entry_list[extremePair.first].get_mbr().get_lowestValue_at(j) 
-					- entry_list[extremePair.second].get_mbr().get_highestValue_at(j)) * 1.0 
-				/ delta;
-		}
-		if (greatestNormalizedSeparation - normalizedJdimSeparation >= -EPSILON)
-		{
-		}
-		else {
-			m1 = extremePair.first;
-			m2 = extremePair.second;
-			greatestNormalizedSeparation = normalizedJdimSeparation;
-		}
-	}
-	//tie breaking
-	if(m1 == m2) {
-		m2 = (m1 == 0 ? 1 : 0);
-		for (int i = 1; i < len; i++) {
-			if(i != m1 && i != m2) {
-				if(tie_breaking(entry_list[i].get_mbr(), entry_list[m2].get_mbr()))
-					m2 = i;
-			}
-		}
-	}
-}
-
-
-//
-// Find the leaf node and delete the ``record''.
-//
-RTNode* RTree::find_leaf(RTNode* node, RTNode** stack, int* entry_idx, int& stack_size, const Entry& record)
-{
-	if (node->level == 0) {
-		for (int i = 0; i < node->entry_num; i++) {
-			if (overlap(node->entries[i].get_mbr(), record.get_mbr())) {
-				swap_entry(node->entries, i, node->entry_num-1); // move the record the the end to indicate ``deleted''
-				node->entry_num--;
-
-				return node;
-			}
-		}
-	}
-	else {
-		for (int i = 0; i < node->entry_num; i++) {
-			if (overlap(node->entries[i].get_mbr(), record.get_mbr())) {
-				stack[stack_size] = node;
-				entry_idx[stack_size] = i;
-				stack_size++;
-				RTNode* ret = find_leaf(node->entries[i].get_ptr(), stack, entry_idx, stack_size, record);
-				if (ret != NULL) {
-					return ret;
-				}
-				stack_size--;
-			}
-		}
-	}
-	return NULL;
-}
-
-//
-// Find the node to insert the new entry ``e'' at the specified level ``dest_level''.
-// In particular, find the leaf node for new record if ``dest_level == 0''.
-//
-RTNode* RTree::choose_leaf(RTNode** stack, int* entry_idx, int& stack_size, const Entry& e, int dest_level)
-{
-	RTNode* node = root;
-	while (node->level != dest_level) {
-		int min_idx = 0;
-		int min_enlargement = area_inc(node->entries[0].get_mbr(), e.get_mbr());
-		for (int i = 1; i < node->entry_num; i++) {
-			// compare with other entries
-			int cur_enlargement = area_inc(node->entries[i].get_mbr(), e.get_mbr());
-			if (cur_enlargement < min_enlargement) {
-				min_idx = i;
-				min_enlargement = cur_enlargement;
-			}
-			else if (cur_enlargement == min_enlargement) {
-				// do not need to change min_enlargement as they are the same.
-				int cur_area = area(node->entries[i].get_mbr());
-				int min_area = area(node->entries[min_idx].get_mbr());
-				// select the one with min area.
-				if (cur_area < min_area) {
-					min_idx = i;
-				}
-				else if (cur_area == min_area) {
-					// tie breaking
-					if (tie_breaking(node->entries[i].get_mbr(), node->entries[min_idx].get_mbr())) {
-						min_idx = i;
-					}
-				}
-			}
-		}
-		//this->print_node(node, 4);
-		stack[stack_size] = node;
-		entry_idx[stack_size] = min_idx;
-		stack_size++;
-		node = node->entries[min_idx].get_ptr();
-	}
-	return node;
-}
-
-
-//
-// Adjust the MBR of nodes involved in insertion.
-//
-void RTree::adjust_tree(RTNode** stack, int* entry_idx, int size)
-{
-	while (size > 0) {
-		size--;
-		RTNode* node = stack[size]->entries[entry_idx[size]].get_ptr();
-		
-		stack[size]->entries[entry_idx[size]].set_mbr(get_mbr(node->entries, node->entry_num));
-	}
-}
-
-
-//
-// Helper function for query_range(), with range specified in ``mbr''.
-// Return: number of results in ``result_cnt''.
-//		number of R-tree nodes traveled in ``node_traveled''.
-void RTree::query_range(const RTNode* node, const BoundingBox mbr, int& result_cnt, int& node_traveled)
-{
-	node_traveled++;
-	if (node->level == 0) {
-		for (int i = 0;i < node->entry_num;i++) {
-			if (overlap(node->entries[i].get_mbr(), mbr)) {
-				result_cnt++;
-			}
-		}
-	} else {
-		for (int i = 0;i < node->entry_num; i++) {
-			if (overlap(node->entries[i].get_mbr(), mbr)) {
-				query_range(node->entries[i].get_ptr(), mbr, result_cnt, node_traveled);
-			}
-		}
-	}
-}
-
-
-//
-// Helper function for point_query().
-//
-bool RTree::query_point(const RTNode* node, const BoundingBox& mbr, Entry& result)
-{
-	if (node->level == 0) {
-		for (int i = 0; i < node->entry_num; i++) {
-			if (overlap(node->entries[i].get_mbr(), mbr)) {
-				result = node->entries[i];
-				return true;
-			}
-		}
-	}
-	else {
-		for (int i = 0; i < node->entry_num; i++) {
-			if (overlap(node->entries[i].get_mbr(), mbr)) {
-				if (query_point(node->entries[i].get_ptr(), mbr, result)) {
-					return true;
-				}
-			}
-		}
-	}
-	return false;
-}	
-
-
-bool RTree::insert(const vector<int>& coordinate, int rid)
-{
-	if (coordinate.size() != this->dimension)
-	{
-		cerr << "R-tree dimensionality inconsistency\n";
-	}
-	//a point is also modeled by a mbr.
-	BoundingBox mbr(coordinate, coordinate);
-	Entry e(mbr, rid);
-	return insert(e, 0);
-}
-
-
-//
-// Helper function for insertion.
-//
-bool RTree::insert(const Entry& e, int dest_level)
-{
-	Entry dummy;
-	if (dest_level == 0 && query_point(root, e.get_mbr(), dummy)) {
-		return false; 
-	} 
-
-	// stack contains the path to the leaf (not including the leaf node).
-	RTNode** stack = new RTNode*[root->level];
-	int stack_size = 0;
-	// entry_idx contains the index of each entry in the node from the path.
-	int* entry_idx = new int[root->level];
-
-	RTNode* leaf = choose_leaf(stack, entry_idx, stack_size, e, dest_level);
-	
-	// check if there is space for the new entry
-	if (leaf->entry_num < max_entry_num) {
-		leaf->entries[leaf->entry_num] = e;//pointer
-		leaf->entry_num++;
-		/*if (stack_size != 0)
-		{
-			this->print_node(stack[0],4);
-		}	*/
-		adjust_tree(stack, entry_idx, stack_size);
-		/*if (stack_size != 0)
-		{
-			this->print_node(stack[0],4);
-		}	*/
-		delete[] stack;
-		delete[] entry_idx;
-		return true;
-	}
-
-	
-	// split is needed.
-	bool split = true;
-	RTNode* node = leaf;
-	Entry new_entry = e;
-	while (split) {
-		Entry* entry_buffer = new Entry[node->entry_num + 1];
-		for (int i = 0; i < node->entry_num; i++) {
-			entry_buffer[i] = node->entries[i];
-		}
-		entry_buffer[max_entry_num] = new_entry;
-
-		int m1, m2;
-		linear_pick_seeds(entry_buffer, max_entry_num+1, m1, m2);
-
-		RTNode* new_node = new RTNode(node->level, max_entry_num);
-		node->entries[0] = entry_buffer[m1];
-		node->entry_num=1;
-		new_node->entries[0] = entry_buffer[m2];
-		new_node->entry_num = 1;
-		// move the selected nodes to the end of the buffer
-		swap_entry(entry_buffer, m2, max_entry_num);
-		if (m1 == max_entry_num) {
-			m1 = m2;
-		}
-		swap_entry(entry_buffer, m1, max_entry_num-1);
-		// (bubble) sort the entries in the remaining set
-		// last one should be picked first.
-		int remain = max_entry_num-1;
-		for (int i = 1; i < remain; i++) {
-			for (int j = 0; j < remain - i; j++) {
-				if (tie_breaking(entry_buffer[j].get_mbr(), entry_buffer[j+1].get_mbr())) {
-					swap_entry(entry_buffer, j, j+1);
-				}
-			}
-		}
-		// split procedure
-		int max_split_size = (max_entry_num) / 2 + 1;
-		BoundingBox old_mbr = node->entries[0].get_mbr();
-		BoundingBox new_mbr = new_node->entries[0].get_mbr();
-		while (node->entry_num < max_split_size && new_node->entry_num < max_split_size) {
-			int old_inc = area_inc(old_mbr, entry_buffer[remain-1].get_mbr());
-			int new_inc = area_inc(new_mbr, entry_buffer[remain-1].get_mbr());
-			bool add_to_old = false;
-			if (old_inc != new_inc) // less enlargement better.
-				add_to_old = old_inc < new_inc;
-			else if (area(old_mbr) != area(new_mbr)) // smaller area better.
-				add_to_old = area(old_mbr) < area(new_mbr);
-			else if (node->entry_num != new_node->entry_num) // fewer entries num better.
-				add_to_old = node->entry_num < new_node->entry_num;
-			else 
-				add_to_old = tie_breaking(old_mbr, new_mbr);
-
-			if (add_to_old) {
-				node->entries[node->entry_num] = entry_buffer[remain-1];
-				node->entry_num++;
-				update_mbr(old_mbr, entry_buffer[remain-1].get_mbr());
-			}
-			else {
-				new_node->entries[new_node->entry_num] = entry_buffer[remain-1];
-				new_node->entry_num++;
-				update_mbr(new_mbr, entry_buffer[remain-1].get_mbr());
-			}
-			remain--;
-		}
-		
-		// one node reaches max num nodes, assign the remaining to the other node
-		if (node->entry_num == max_split_size) {
-			for (int i = remain-1; i >= 0; i--) {
-				new_node->entries[new_node->entry_num] = entry_buffer[i];
-				new_node->entry_num++;
-				update_mbr(new_mbr, entry_buffer[i].get_mbr());
-			}
-		}
-		else {
-			for (int i = remain-1; i >= 0; i--) {
-				node->entries[node->entry_num] = entry_buffer[i];
-				node->entry_num++;
-				update_mbr(old_mbr, entry_buffer[i].get_mbr());
-			}
-		}
-		// two nodes now. go to a higher level
-		if (stack_size == 0) {
-			// root reached.
-			RTNode* new_root = new RTNode(node->level+1, max_entry_num);
-			new_root->entries[0].set_mbr(old_mbr);
-			new_root->entries[0].set_ptr(node);
-			new_root->entries[1].set_mbr(new_mbr);
-			new_root->entries[1].set_ptr(new_node);
-			new_root->entry_num = 2;
-			root = new_root;
-			split = false;
-		}
-		else {
-			stack_size--;
-			RTNode* parent = stack[stack_size];
-			int idx = entry_idx[stack_size];
-			parent->entries[idx].set_mbr(old_mbr);
-			new_entry.set_mbr(new_mbr);
-			new_entry.set_ptr(new_node);
-			if (parent->entry_num < max_entry_num) {
-				parent->entries[parent->entry_num] = new_entry;
-				parent->entry_num++;
-				split = false;
-			}
-			else
-				node = parent;
-		}
-
-		delete []entry_buffer;
-	}
-	adjust_tree(stack, entry_idx, stack_size);
-
-	delete []stack;
-	delete []entry_idx;
-	return true;
-}
-
-
-//
-// Condense tree due to deletion of nodes.
-//
-void RTree::condense_tree(RTNode** stack, int* entry_idx, int size)
-{
-	int size_before_mod = size;
-
-	RTNode** deleted_stack = new RTNode*[root->level];
-	int deleted_size = 0;
-
-	while (size > 0) {
-		size--;
-		RTNode* node = stack[size]->entries[entry_idx[size]].get_ptr();
-		int m = max_entry_num/2 + 1;
-		if (node->entry_num < m){
-			// 1. remove this from the parent node
-			swap_entry(stack[size]->entries, entry_idx[size], stack[size]->entry_num-1); // move the record the the end to indicate ``deleted''
-            stack[size]->entry_num--;
-			//2. insert the node into deleted_stack
-			deleted_stack[deleted_size++] = node;
-		}
-	}
-	//adjustment the mbr of the tree affect due to deletion of nodes
-	adjust_tree(stack,entry_idx,size_before_mod);
-	//then do the insertion
-	while(deleted_size>0){
-		deleted_size--;
-		RTNode* deleted_node = deleted_stack[deleted_size];
-
-		// (bubble) sort the entries in the remaining set
-    	for (int j = 0; j < deleted_node->entry_num-1; j++) {
-        	if (tie_breaking(deleted_node->entries[j].get_mbr(), deleted_node->entries[j+1].get_mbr())) {
-        			swap_entry(deleted_node->entries, j, j+1);
-       		}
-     	}
-
-		//re-insertion according to the order
-		for(int i=0;i<deleted_node->entry_num;++i){
-			insert(deleted_node->entries[i],deleted_node->level);
-		}
-	}
-	if (root->entry_num==1) root = root->entries[0].get_ptr();
-	delete []deleted_stack;
-
-}
-
-
-bool RTree::del(const vector<int>& coordinate)
-{
-	if (coordinate.size() != this->dimension)
-	{
-		cerr << "R-tree dimensionality inconsistency\n";
-	}
-	/*
-	Add your code here
-	*/
-	BoundingBox mbr(coordinate,coordinate);
-	Entry e(mbr, 0);//dummy rid to be 0
-//RTNode* RTree::find_leaf(RTNode* node, RTNode** stack, int* entry_idx, int& stack_size, const Entry& record)
-
-	RTNode** stack = new RTNode*[root->level];
-    int stack_size = 0;
-    	// entry_idx contains the index of each entry in the node from the path.
-   	int* entry_idx = new int[root->level];
-    //find the leaf node containing the target entry and remove the entry from the node.if NULL, the entry doesnt exist
-   	RTNode* leaf = find_leaf(root,stack, entry_idx, stack_size, e);
-	if(leaf==NULL){//the entry does not exist
-		delete []stack;
-        delete []entry_idx;
-		return false;
-	}
-//	else if(leaf->level==level){//it is the root
-//	//update the mbr first and then do the re-insertion of all its entries
-//		leaf->set_mbr(get_mbr(leaf->entries,leaf->entry_num));
-//    	// (bubble) sort the entries in the remaining set
-//       	for (int j = 0; j < leaf->entry_num-1; j++) {
-//           	if (tie_breaking(leaf->entries[j].get_mbr(), leaf->entries[j+1].get_mbr())) {
-//           			swap_entry(leaf->entries, j, j+1);
-//           	}
-//       	}
-//
-//    		//re-insertion according to the order
-//    		for(int i=0;i<leaf->entry_num;++i){
-//    			insert(leaf->entries[i],leaf->level);
-//    		}
-//    	}
-//	}else{
-		condense_tree(stack,entry_idx,stack_size);
-
-
-
-
-	delete []stack;
-    delete []entry_idx;
-    return true;
-}
-
-
-
-void RTree::query_range(const BoundingBox& mbr, int& result_count, int& node_travelled)
-{
-	
-	result_count = 0;
-	node_travelled = 0;
-	query_range(root, mbr, result_count, node_travelled);
-}
-
-
-bool RTree::query_point(const vector<int>& coordinate, Entry& result)
-{
-	BoundingBox mbr(coordinate, coordinate);
-	return query_point(root, mbr, result);
-}
-
-
-/**********************************
- *
- * Please do not modify the codes below
- *
- **********************************/
-
-/*********************************************************
-  Return true means choose box1 for tie breaking.
-  If the two boxes is the same, return true.
-  This is to give a unified way of tie-breaking such that if your program is correct, then the result should be same, not influnced by any ties.
- *********************************************************/
-bool RTree::tie_breaking(const BoundingBox& box1, const BoundingBox& box2)
-{
-	//for every dimension, try to break tie by the lowest value, then the highest
-	for (int i = 0; i < box1.get_dim(); i++)
-	{
-		if (box1.get_lowestValue_at(i) != box2.get_lowestValue_at(i))
-		{
-			return box1.get_lowestValue_at(i) < box2.get_lowestValue_at(i);
-		}
-		else if (box1.get_highestValue_at(i) != box2.get_highestValue_at(i))
-		{
-			return box1.get_highestValue_at(i) > box2.get_highestValue_at(i);
-		}
-	}
-	return true;
-}
-
-
-void RTree::stat(RTNode* node, int& record_cnt, int& node_cnt)
-{
-	if (node->level == 0) {
-		record_cnt += node->entry_num;
-		node_cnt++;
-	}
-	else {
-		node_cnt++;
-		for (int i = 0; i < node->entry_num; i++)
-			stat((node->entries[i]).get_ptr(), record_cnt, node_cnt);
-	}
-}
-
-void RTree::stat()
-{
-	int record_cnt = 0, node_cnt = 0;
-	stat(root, record_cnt, node_cnt);
-	cout << "Height of R-tree: " << root->level + 1 << endl;
-	cout << "Number of nodes: " << node_cnt << endl;
-	cout << "Number of records: " << record_cnt << endl;
-	cout << "Dimension: " << dimension << endl;
-}
-
-
-void RTree::print_node(RTNode* node, int indent_level)
-{
-	BoundingBox mbr = get_mbr(node->entries, node->entry_num);
-
-	char* indent = new char[4*indent_level+1];
-	memset(indent, ' ', sizeof(char) * 4 * indent_level);
-	indent[4*indent_level] = '\0';
-
-	if (node->level == 0) {
-		cout << indent << "Leaf node (level = " << node->level << ") mbr: (";
-		for (int i = 0; i < mbr.get_dim(); i++)
-		{
-			cout << mbr.get_lowestValue_at(i) << " " << mbr.get_highestValue_at(i);
-			if (i != mbr.get_dim() - 1)
-			{
-				cout << " ";
-			}
-		}
-		cout << ")\n";
-	}
-	else {
-
-		cout << indent << "Non leaf node (level = " << node->level << ") mbr: (";
-		for (int i = 0; i < mbr.get_dim(); i++)
-		{
-			cout << mbr.get_lowestValue_at(i) << " " << mbr.get_highestValue_at(i);
-			if (i != mbr.get_dim() - 1)
-			{
-				cout << " ";
-			}
-		}
-		cout << ")\n";
-	}
-
-	Entry *copy = new Entry[node->entry_num];
-	for (int i = 0; i < node->entry_num; i++) {
-		copy[i] = node->entries[i];
-	}
-
-	for (int i = 0; i < node->entry_num; i++) {
-		int index = 0; // pick next.
-		for (int j = 1; j < node->entry_num - i; j++) {
-			if (tie_breaking(copy[j].get_mbr(), copy[index].get_mbr())) {
-				index = j;
-			}
-		}
-
-		if (node->level == 0) {
-			Entry& e = copy[index];
-			cout << indent << "    Entry: <";
-			for (int i = 0; i < e.get_mbr().get_dim(); i++)
-			{
-				cout << e.get_mbr().get_lowestValue_at(i) << ", ";
-			}
-			cout << e.get_rid() << ">\n";
-		}
-		else {
-			print_node(copy[index].get_ptr(), indent_level+1);
-		}
-		// Move the output one to the rear.
-		Entry tmp = copy[node->entry_num - i - 1];
-		copy[node->entry_num - i - 1] = copy[index];
-		copy[index] = tmp;
-
-	}
-
-	delete []indent;
-	delete []copy;
-}
-
-void RTree::print_tree()
-{
-	if (root->entry_num == 0)
-		cout << "The tree is empty now." << endl;
-	else
-		print_node(root, 0);
-}
+/* Implementations of R tree */
+#include <algorithm>
+#include <cassert>
+#include <climits>
+#include <cmath>
+#include "rtree.h"
+#include "nearest.h"
+#include "hilbert.h"
+#include "threadpool.h"
+#include "nodepool.h"
+
+
+const double EPSILON = 1E-10;
+// longest entry list exhaustive_split() searches; longer lists are split quadratically.
+const int MAX_EXHAUSTIVE_SPLIT = 17;
+// records a range query is estimated to reach before it is searched in parallel.
+const long long PARALLEL_QUERY_RECORDS = 1 << 14;
+// queries a batch needs before query_range_batch() splits it among threads.
+const int PARALLEL_BATCH_QUERIES = 256;
+
+
+// Appends every record it visits to a result buffer.
+template <int D>
+class EntryCollector : public EntryVisitor<D> {
+	public:
+		EntryCollector(vector<Entry<D> >& buffer) : results(buffer) {}
+		bool visit(const Entry<D>& e) { results.push_back(e); return true; }
+
+	private:
+		vector<Entry<D> >& results;
+};
+
+
+// Orders entries by the center of their MBR on dimension ``dim''.
+template <int D>
+class CenterLess {
+	public:
+		CenterLess(int d) : dim(d) {}
+		bool operator()(const Entry<D>& e1, const Entry<D>& e2) const {
+			const BoundingBox<D>& mbr1 = e1.get_mbr();
+			const BoundingBox<D>& mbr2 = e2.get_mbr();
+			return (long long)mbr1.get_lowestValue_at(dim) + mbr1.get_highestValue_at(dim)
+				< (long long)mbr2.get_lowestValue_at(dim) + mbr2.get_highestValue_at(dim);
+		}
+
+	private:
+		int dim;
+};
+
+
+// Orders entries by the coordinates of their MBR, lowest corner first.
+template <int D>
+class CoordLess {
+	public:
+		bool operator()(const Entry<D>& e1, const Entry<D>& e2) const {
+			const BoundingBox<D>& mbr1 = e1.get_mbr();
+			const BoundingBox<D>& mbr2 = e2.get_mbr();
+			for (int i = 0; i < mbr1.get_dim(); i++) {
+				if (mbr1.get_lowestValue_at(i) != mbr2.get_lowestValue_at(i))
+					return mbr1.get_lowestValue_at(i) < mbr2.get_lowestValue_at(i);
+			}
+			for (int i = 0; i < mbr1.get_dim(); i++) {
+				if (mbr1.get_highestValue_at(i) != mbr2.get_highestValue_at(i))
+					return mbr1.get_highestValue_at(i) < mbr2.get_highestValue_at(i);
+			}
+			return false;
+		}
+};
+
+
+// Orders entries along one axis by the lower edge of their MBR (the upper
+// edge breaks ties), or by the upper edge first if ``by_high'' is set.
+template <int D>
+class EdgeLess {
+	public:
+		EdgeLess(int d, bool high) : dim(d), by_high(high) {}
+		bool operator()(const Entry<D>& e1, const Entry<D>& e2) const {
+			const BoundingBox<D>& mbr1 = e1.get_mbr();
+			const BoundingBox<D>& mbr2 = e2.get_mbr();
+			int first1 = by_high ? mbr1.get_highestValue_at(dim) : mbr1.get_lowestValue_at(dim);
+			int first2 = by_high ? mbr2.get_highestValue_at(dim) : mbr2.get_lowestValue_at(dim);
+			if (first1 != first2)
+				return first1 < first2;
+			int second1 = by_high ? mbr1.get_lowestValue_at(dim) : mbr1.get_highestValue_at(dim);
+			int second2 = by_high ? mbr2.get_lowestValue_at(dim) : mbr2.get_highestValue_at(dim);
+			return second1 < second2;
+		}
+
+	private:
+		int dim;
+		bool by_high;
+};
+
+
+//
+// Sort [first, first + len) with the threads of ``pool'': chunks are sorted
+// concurrently, then merged pairwise. Equal elements keep their order.
+//
+template <class T, class Compare>
+static void parallel_sort(T* first, int len, Compare comp, ThreadPool& pool)
+{
+	int chunk_cnt = pool.get_thread_num();
+	if (chunk_cnt <= 1 || len < 4096) {
+		stable_sort(first, first + len, comp);
+		return;
+	}
+
+	vector<int> bounds;
+	for (int c = 0; c <= chunk_cnt; c++)
+		bounds.push_back((long long)len * c / chunk_cnt);
+	for (int c = 0; c < chunk_cnt; c++) {
+		int from = bounds[c], to = bounds[c + 1];
+		pool.submit([=]() { stable_sort(first + from, first + to, comp); });
+	}
+	pool.wait();
+	for (int width = 1; width < chunk_cnt; width *= 2) {
+		for (int c = 0; c + width < chunk_cnt; c += 2 * width) {
+			int from = bounds[c], mid = bounds[c + width], to = bounds[min(c + 2 * width, chunk_cnt)];
+			pool.submit([=]() { inplace_merge(first + from, first + mid, first + to, comp); });
+		}
+		pool.wait();
+	}
+}
+
+
+// True if two entries have the same MBR.
+template <int D>
+class SameMBR {
+	public:
+		bool operator()(const Entry<D>& e1, const Entry<D>& e2) const {
+			return e1.get_mbr().is_equal(e2.get_mbr());
+		}
+};
+
+template <int D>
+RTree<D>::RTree(int entry_num)
+	: RTree(entry_num, D != DYNAMIC_DIM ? D : 2, GUTTMAN_INSERT, LINEAR_SPLIT)//by default
+{
+}
+
+template <int D>
+RTree<D>::RTree(int entry_num, int dim)
+	: RTree(entry_num, dim, GUTTMAN_INSERT, LINEAR_SPLIT)
+{
+}
+
+template <int D>
+RTree<D>::RTree(int entry_num, int dim, InsertMode mode)
+	: RTree(entry_num, dim, mode, mode == RSTAR_INSERT ? RSTAR_SPLIT : LINEAR_SPLIT)
+{
+}
+
+template <int D>
+RTree<D>::RTree(int entry_num, int dim, InsertMode mode, SplitMethod split)
+{
+	if (D != DYNAMIC_DIM && dim != D)
+	{
+		cerr << "R-tree dimensionality inconsistency\n";
+	}
+	max_entry_num = entry_num;
+	dimension = D != DYNAMIC_DIM ? D : dim;
+	node_pool = new NodePool<D>(entry_num, dimension);
+	root = node_pool->alloc(0);
+	use_locator = false;
+	buffer_size = 0;
+	buffered_cnt = 0;
+	lazy_delete = false;
+	compact_ratio = 0;
+	tombstone_cnt = 0;
+	compact_check = 0;
+	snapshots = false;
+	published.store(root);
+	split_cnt.store(0);
+	insert_mode = mode;
+	split_method = split;
+}
+
+template <int D>
+RTree<D>::~RTree()
+{
+	delete node_pool;
+	root = NULL;
+}
+
+
+//
+// Check whether two entries are the same.
+// Return true if same, otherwise false.
+//
+template <int D>
+bool RTree<D>::same_entry(const Entry<D>& e1, const Entry<D>& e2)
+{
+	const BoundingBox<D>& mbr1 = e1.get_mbr();
+	const BoundingBox<D>& mbr2 = e2.get_mbr();
+	
+	return mbr1.is_equal(mbr2);
+}
+
+
+//
+// Check whether two boundingboxs overlap.
+// Return true if so, otherwise false.
+//
+template <int D>
+bool RTree<D>::overlap(const BoundingBox<D>& box1, const BoundingBox<D>& box2)
+{
+	return box1.is_intersected(box2);
+}
+
+
+//
+// Update the current MBR ``mbr'' with the merging result of ``mbr'' and ``new_mbr''
+//
+template <int D>
+void RTree<D>::update_mbr(BoundingBox<D>& mbr, const BoundingBox<D>& new_mbr)
+{
+	mbr.group_with(new_mbr);
+}
+
+
+//
+// Calculate the MBR of a set of entries, of size ``len''.
+
+template <int D>
+BoundingBox<D> RTree<D>::get_mbr(Entry<D>* entry_list, int len)
+{
+	BoundingBox<D> mbr(entry_list[0].get_mbr());
+	for (int i = 1; i < len; i++) {        
+		mbr.group_with(entry_list[i].get_mbr());
+	}
+	return mbr;
+}
+
+
+//
+// Return the area of a boundingbox ``mbr''.
+//
+template <int D>
+int RTree<D>::area(const BoundingBox<D>& mbr)
+{
+	return mbr.get_area();
+}
+
+
+//
+// Swap two entries: entry_list[id1] and entry_list[id2].
+//
+template <int D>
+void RTree<D>::swap_entry(Entry<D>* entry_list, int id1, int id2)
+{
+	Entry<D> temp = entry_list[id1];
+	entry_list[id1] = entry_list[id2];
+	entry_list[id2] = temp;
+}
+
+
+//
+// Calculate the area enlarged by add the new entry to the existing MBR.
+//
+template <int D>
+int RTree<D>::area_inc(const BoundingBox<D>& mbr, const BoundingBox<D>& entry_mbr)
+{
+	BoundingBox<D> new_mbr(mbr);
+	new_mbr.group_with(entry_mbr);
+	return area(new_mbr) - area(mbr);
+}
+
+//
+// Linear Pick Seeds algorithm for Lienar Cost Algorithm.
+//
+template <int D>
+void RTree<D>::linear_pick_seeds(Entry<D>* entry_list, int len, int& m1, int& m2)
+{
+	int iminx = 0, imaxx = 0, iminy = 0, imaxy = 0;    
+	int dim = entry_list[0].get_mbr().get_dim();
+
+	//extreme pairs for each dimension
+	//for a pair, first element is the entry with highest low side, second is the entry with lowest high side
+	// per thread, not per tree: insert_latched() splits nodes on several threads at once.
+	static thread_local vector<pair<int,int> > extremePairs;
+	extremePairs.clear();
+	//initialize entreme pairs
+	for (int i = 0; i < dim; i++)
+	{
+		pair<int, int> extremePair(0, 0);//the first entry by default
+		extremePairs.push_back(extremePair);
+	}
+	// pick the two entries with the largest gap on each dimension
+	//for every entry
+	for (int i = 1; i < len; i++) {
+		//for every dimension
+		for (int j = 0; j < dim; j++)
+		{
+			pair<int, int> extremePair = extremePairs[j];
+			const BoundingBox<D>& ithMBR = entry_list[i].get_mbr();
+
+			//get highest low side on j-th dimension
+			//the MBR of entry that has highest low side on dimension j
+			const BoundingBox<D>& highestLowEntryMBR = entry_list[extremePair.first].get_mbr();
+			if (ithMBR.get_lowestValue_at(j) > highestLowEntryMBR.get_lowestValue_at(j)) {
+				extremePairs[j].first = i;
+			}
+			else if (ithMBR.get_lowestValue_at(j) == highestLowEntryMBR.get_lowestValue_at(j)) {
+				if (tie_breaking(ithMBR, highestLowEntryMBR)) {
+					extremePairs[j].first = i;
+				}
+			}
+
+			//get lowest high side on j-th dimension
+			const BoundingBox<D>& lowestHighEntryMBR = entry_list[extremePair.second].get_mbr();
+			if (ithMBR.get_highestValue_at(j) < lowestHighEntryMBR.get_highestValue_at(j))
+
+			{
+				extremePairs[j].second = i;
+			}
+			else if (ithMBR.get_highestValue_at(j) == lowestHighEntryMBR.get_highestValue_at(j))
+			{
+				if (tie_breaking(ithMBR, lowestHighEntryMBR)) {
+					extremePairs[j].second = i;
+				}
+			}
+		}
+
+	}
+	BoundingBox<D> box = get_mbr(entry_list, len);
+	
+	//for each dimension, find the greatest normalized separation and store the respective pair in m1 and m2
+	//init
+	double greatestNormalizedSeparation = -1; // the normal value of this should be >= 0
+	m1 = -1;
+	m2 = -1;
+	for (int j = 0; j < dim; j++)
+	{
+		double normalizedJdimSeparation = 0;
+		double delta = box.get_highestValue_at(j) - box.get_lowestValue_at(j);
+
+		pair<int, int> extremePair = extremePairs[j];
+		if (delta != 0)
+		{
+			normalizedJdimSeparation = 
+				abs(entry_list[extremePair.first].get_mbr().get_lowestValue_at(j) 
+					- entry_list[extremePair.second].get_mbr().get_highestValue_at(j)) * 1.0 
+				/ delta;
+		}
+		if (greatestNormalizedSeparation - normalizedJdimSeparation >= -EPSILON)
+		{
+		}
+		else {
+			m1 = extremePair.first;
+			m2 = extremePair.second;
+			greatestNormalizedSeparation = normalizedJdimSeparation;
+		}
+	}
+	//tie breaking
+	if(m1 == m2) {
+		m2 = (m1 == 0 ? 1 : 0);
+		for (int i = 1; i < len; i++) {
+			if(i != m1 && i != m2) {
+				if(tie_breaking(entry_list[i].get_mbr(), entry_list[m2].get_mbr()))
+					m2 = i;
+			}
+		}
+	}
+}
+
+
+//
+// Find the leaf node and delete the ``record''.
+//
+template <int D>
+RTNode<D>* RTree<D>::find_leaf(RTNode<D>* node, RTNode<D>** stack, int* entry_idx, int& stack_size, const Entry<D>& record)
+{
+	if (node->level == 0) {
+		for (int i = 0; i < node->entry_num; i++) {
+			if (overlap(node->entries[i].get_mbr(), record.get_mbr()) && !node->entries[i].is_deleted()) {
+				node = own_path(stack, entry_idx, stack_size, node);
+				node->remove_entry(i); // move the record the the end to indicate ``deleted''
+
+				return node;
+			}
+		}
+	}
+	else {
+		for (int i = 0; i < node->entry_num; i++) {
+			if (overlap(node->entries[i].get_mbr(), record.get_mbr())) {
+				stack[stack_size] = node;
+				entry_idx[stack_size] = i;
+				stack_size++;
+				RTNode<D>* ret = find_leaf(node->entries[i].get_ptr(), stack, entry_idx, stack_size, record);
+				if (ret != NULL) {
+					return ret;
+				}
+				stack_size--;
+			}
+		}
+	}
+	return NULL;
+}
+
+//
+// Find the leaf node holding the live record with record id ``rid'' and, unless ``key'' is
+// NULL, an MBR equal to ``key''. Only subtrees containing ``key'' are searched.
+// Return: the leaf, or NULL; the index of the record in ``idx''.
+//
+template <int D>
+RTNode<D>* RTree<D>::find_record(RTNode<D>* node, RTNode<D>** stack, int* entry_idx, int& stack_size, const BoundingBox<D>* key, int rid, int& idx)
+{
+	for (int i = 0; i < node->entry_num; i++) {
+		if (key != NULL && !overlap(node->entries[i].get_mbr(), *key))
+			continue;
+		if (node->level == 0) {
+			if (node->entries[i].get_rid() == rid && !node->entries[i].is_deleted()
+				&& (key == NULL || node->entries[i].get_mbr().is_equal(*key))) {
+				idx = i;
+				return node;
+			}
+		}
+		else {
+			stack[stack_size] = node;
+			entry_idx[stack_size] = i;
+			stack_size++;
+			RTNode<D>* ret = find_record(node->entries[i].get_ptr(), stack, entry_idx, stack_size, key, rid, idx);
+			if (ret != NULL) {
+				return ret;
+			}
+			stack_size--;
+		}
+	}
+	return NULL;
+}
+
+
+//
+// Find the path from ``node'' down to ``leaf'', which holds a record with MBR ``mbr''.
+// Return: whether ``leaf'' was reached, with the path in ``stack'' and ``entry_idx''.
+//
+template <int D>
+bool RTree<D>::find_path(RTNode<D>* node, const RTNode<D>* leaf, const BoundingBox<D>& mbr, RTNode<D>** stack, int* entry_idx, int& stack_size)
+{
+	if (node == leaf)
+		return true;
+	if (node->level <= leaf->level)
+		return false;
+	for (int i = 0; i < node->entry_num; i++) {
+		if (overlap(node->entries[i].get_mbr(), mbr)) {
+			stack[stack_size] = node;
+			entry_idx[stack_size] = i;
+			stack_size++;
+			if (find_path(node->entries[i].get_ptr(), leaf, mbr, stack, entry_idx, stack_size))
+				return true;
+			stack_size--;
+		}
+	}
+	return false;
+}
+
+
+//
+// Point the locator entries of the records in ``node'' to it, if ``node'' is a leaf.
+//
+template <int D>
+void RTree<D>::locate(RTNode<D>* node)
+{
+	if (use_locator && node->level == 0) {
+		for (int i = 0; i < node->entry_num; i++) {
+			if (!node->entries[i].is_deleted())
+				locator[node->entries[i].get_rid()] = node;
+		}
+	}
+}
+
+
+//
+// locate() every leaf in the subtree of ``node''.
+//
+template <int D>
+void RTree<D>::locate_all(RTNode<D>* node)
+{
+	if (node->level == 0) {
+		locate(node);
+		return;
+	}
+	for (int i = 0; i < node->entry_num; i++)
+		locate_all(node->entries[i].get_ptr());
+}
+
+
+//
+// Choose the entry of ``node'' to descend through with an entry of MBR ``mbr'' headed
+// for level ``dest_level''.
+//
+template <int D>
+int RTree<D>::choose_subtree(RTNode<D>* node, const BoundingBox<D>& mbr, int dest_level)
+{
+	int min_idx = 0;
+	if (insert_mode == RSTAR_INSERT && node->level == dest_level + 1) {
+		min_idx = least_overlap_enlargement(node, mbr);
+	}
+	else {
+		int min_enlargement = area_inc(node->entries[0].get_mbr(), mbr);
+		for (int i = 1; i < node->entry_num; i++) {
+			// compare with other entries
+			int cur_enlargement = area_inc(node->entries[i].get_mbr(), mbr);
+			if (cur_enlargement < min_enlargement) {
+				min_idx = i;
+				min_enlargement = cur_enlargement;
+			}
+			else if (cur_enlargement == min_enlargement) {
+				// do not need to change min_enlargement as they are the same.
+				int cur_area = area(node->entries[i].get_mbr());
+				int min_area = area(node->entries[min_idx].get_mbr());
+				// select the one with min area.
+				if (cur_area < min_area) {
+					min_idx = i;
+				}
+				else if (cur_area == min_area) {
+					// tie breaking
+					if (tie_breaking(node->entries[i].get_mbr(), node->entries[min_idx].get_mbr())) {
+						min_idx = i;
+					}
+				}
+			}
+		}
+	}
+	return min_idx;
+}
+
+
+//
+// Find the node to insert the new entry ``e'' at the specified level ``dest_level''.
+// In particular, find the leaf node for new record if ``dest_level == 0''.
+// The descent starts below the path already in ``stack'', if ``stack_size'' is not 0.
+// A record whose key is already in the tree is looked for on the way down: the subtrees
+// containing the key other than the chosen one are searched as the descent passes them.
+// This is skipped if ``check_dup'' is not set.
+// Return: NULL if such a record exists, with its leaf in ``dup_leaf'' and index in ``dup_idx''.
+//
+template <int D>
+RTNode<D>* RTree<D>::choose_leaf(RTNode<D>** stack, int* entry_idx, int& stack_size, const Entry<D>& e, int dest_level,
+	bool check_dup, RTNode<D>*& dup_leaf, int& dup_idx)
+{
+	dup_leaf = NULL;
+	bool check = check_dup && dest_level == 0; // the chosen path may still hold the key
+	RTNode<D>* node = stack_size > 0 ? stack[stack_size-1]->entries[entry_idx[stack_size-1]].get_ptr() : root;
+	while (node->level != dest_level) {
+		int min_idx = choose_subtree(node, e.get_mbr(), dest_level);
+		//this->print_node(node, 4);
+		if (check) {
+			bool on_path = false;
+			for (int base = 0; base < node->entry_num; base += 64) {
+				unsigned long long hits = node->intersect_mask(e.get_mbr(), base);
+				while (hits != 0) {
+					int i = base + __builtin_ctzll(hits);
+					hits &= hits - 1;
+					if (i == min_idx)
+						on_path = true;
+					else if (find_entry(node->entries[i].get_ptr(), e.get_mbr(), dup_leaf, dup_idx))
+						return NULL;
+				}
+			}
+			check = on_path;
+		}
+		stack[stack_size] = node;
+		entry_idx[stack_size] = min_idx;
+		stack_size++;
+		node = node->entries[min_idx].get_ptr();
+	}
+	if (check && find_entry(node, e.get_mbr(), dup_leaf, dup_idx))
+		return NULL;
+	return node;
+}
+
+
+//
+// Helper function for choose_leaf(): find a record intersecting ``mbr'' in the subtree of ``node''.
+// Return: whether there is one, with its leaf in ``leaf'' and its index in ``idx''.
+//
+template <int D>
+bool RTree<D>::find_entry(RTNode<D>* node, const BoundingBox<D>& mbr, RTNode<D>*& leaf, int& idx)
+{
+	return find_entry(node, mbr, false, leaf, idx);
+}
+
+
+//
+// As find_entry() above, passing over tombstones if ``live'' is set.
+//
+template <int D>
+bool RTree<D>::find_entry(RTNode<D>* node, const BoundingBox<D>& mbr, bool live, RTNode<D>*& leaf, int& idx)
+{
+	for (int base = 0; base < node->entry_num; base += 64) {
+		unsigned long long hits = node->intersect_mask(mbr, base);
+		while (hits != 0) {
+			int i = base + __builtin_ctzll(hits);
+			hits &= hits - 1;
+			if (node->level == 0) {
+				if (live && node->entries[i].is_deleted())
+					continue;
+				leaf = node;
+				idx = i;
+				return true;
+			}
+			if (find_entry(node->entries[i].get_ptr(), mbr, live, leaf, idx)) {
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+
+//
+// Linear split: distribute the max_entry_num + 1 entries of ``entry_list'' between ``node''
+// and ``new_node'', starting from the seeds of linear_pick_seeds().
+// Return: the MBRs of the two nodes in ``old_mbr'' and ``new_mbr''.
+//
+template <int D>
+void RTree<D>::linear_split(Entry<D>* entry_list, RTNode<D>* node, RTNode<D>* new_node, BoundingBox<D>& old_mbr, BoundingBox<D>& new_mbr)
+{
+	Entry<D>* entry_buffer = entry_list;
+	int m1, m2;
+	linear_pick_seeds(entry_buffer, max_entry_num+1, m1, m2);
+
+	node->set_entry(0, entry_buffer[m1]);
+	node->entry_num=1;
+	new_node->add_entry(entry_buffer[m2]);
+	// move the selected nodes to the end of the buffer
+	swap_entry(entry_buffer, m2, max_entry_num);
+	if (m1 == max_entry_num) {
+		m1 = m2;
+	}
+	swap_entry(entry_buffer, m1, max_entry_num-1);
+	// (bubble) sort the entries in the remaining set
+	// last one should be picked first.
+	int remain = max_entry_num-1;
+	for (int i = 1; i < remain; i++) {
+		for (int j = 0; j < remain - i; j++) {
+			if (tie_breaking(entry_buffer[j].get_mbr(), entry_buffer[j+1].get_mbr())) {
+				swap_entry(entry_buffer, j, j+1);
+			}
+		}
+	}
+	// split procedure
+	int max_split_size = (max_entry_num) / 2 + 1;
+	old_mbr = node->entries[0].get_mbr();
+	new_mbr = new_node->entries[0].get_mbr();
+	while (node->entry_num < max_split_size && new_node->entry_num < max_split_size) {
+		int old_inc = area_inc(old_mbr, entry_buffer[remain-1].get_mbr());
+		int new_inc = area_inc(new_mbr, entry_buffer[remain-1].get_mbr());
+		bool add_to_old = false;
+		if (old_inc != new_inc) // less enlargement better.
+			add_to_old = old_inc < new_inc;
+		else if (area(old_mbr) != area(new_mbr)) // smaller area better.
+			add_to_old = area(old_mbr) < area(new_mbr);
+		else if (node->entry_num != new_node->entry_num) // fewer entries num better.
+			add_to_old = node->entry_num < new_node->entry_num;
+		else 
+			add_to_old = tie_breaking(old_mbr, new_mbr);
+
+		if (add_to_old) {
+			node->add_entry(entry_buffer[remain-1]);
+			update_mbr(old_mbr, entry_buffer[remain-1].get_mbr());
+		}
+		else {
+			new_node->add_entry(entry_buffer[remain-1]);
+			update_mbr(new_mbr, entry_buffer[remain-1].get_mbr());
+		}
+		remain--;
+	}
+	
+	// one node reaches max num nodes, assign the remaining to the other node
+	if (node->entry_num == max_split_size) {
+		for (int i = remain-1; i >= 0; i--) {
+			new_node->add_entry(entry_buffer[i]);
+			update_mbr(new_mbr, entry_buffer[i].get_mbr());
+		}
+	}
+	else {
+		for (int i = remain-1; i >= 0; i--) {
+			node->add_entry(entry_buffer[i]);
+			update_mbr(old_mbr, entry_buffer[i].get_mbr());
+		}
+	}
+}
+
+
+//
+// R* ChooseSubtree for nodes pointing to the destination level: pick the entry
+// whose MBR overlaps least more with its siblings once ``mbr'' is added.
+// Ties are broken by area enlargement, then by area.
+//
+template <int D>
+int RTree<D>::least_overlap_enlargement(RTNode<D>* node, const BoundingBox<D>& mbr)
+{
+	int min_idx = -1;
+	double min_overlap_inc = 0, min_area_inc = 0, min_area = 0;
+	for (int i = 0; i < node->entry_num; i++) {
+		const BoundingBox<D>& cur = node->entries[i].get_mbr();
+		BoundingBox<D> grown = cur;
+		grown.group_with(mbr);
+		double overlap_inc = 0;
+		for (int j = 0; j < node->entry_num; j++) {
+			if (j != i) {
+				const BoundingBox<D>& other = node->entries[j].get_mbr();
+				overlap_inc += grown.get_overlap(other) - cur.get_overlap(other);
+			}
+		}
+		double cur_area = cur.get_area();
+		double area_inc = (double)grown.get_area() - cur_area;
+		if (min_idx < 0 || overlap_inc < min_overlap_inc
+			|| (overlap_inc == min_overlap_inc && (area_inc < min_area_inc
+			|| (area_inc == min_area_inc && cur_area < min_area)))) {
+			min_idx = i;
+			min_overlap_inc = overlap_inc;
+			min_area_inc = area_inc;
+			min_area = cur_area;
+		}
+	}
+	return min_idx;
+}
+
+
+//
+// R* split of the ``len'' entries in ``entry_list'' between ``node'' and ``new_node''.
+// The split axis minimises the summed margins of all candidate distributions;
+// on that axis the distribution with the least overlap (then least area) wins.
+// Return: the MBRs of the two nodes in ``old_mbr'' and ``new_mbr''.
+//
+template <int D>
+void RTree<D>::rstar_split(Entry<D>* entry_list, int len, RTNode<D>* node, RTNode<D>* new_node, BoundingBox<D>& old_mbr, BoundingBox<D>& new_mbr)
+{
+	int min_fill = max(1, max_entry_num * 2 / 5);
+	int dist_num = len - 2 * min_fill + 1;
+	// prefix[k] bounds entries [0, k], suffix[k] bounds entries [k, len).
+	// per thread, as in linear_pick_seeds().
+	static thread_local vector<BoundingBox<D> > prefix, suffix;
+	if ((int)prefix.size() < len) {
+		prefix.resize(len);
+		suffix.resize(len);
+	}
+
+	int best_axis = 0;
+	double best_margin = 0;
+	for (int d = 0; d < dimension; d++) {
+		double margin = 0;
+		for (int by_high = 0; by_high < 2; by_high++) {
+			sort(entry_list, entry_list + len, EdgeLess<D>(d, by_high != 0));
+			prefix[0] = entry_list[0].get_mbr();
+			for (int i = 1; i < len; i++) {
+				prefix[i] = prefix[i-1];
+				prefix[i].group_with(entry_list[i].get_mbr());
+			}
+			suffix[len-1] = entry_list[len-1].get_mbr();
+			for (int i = len - 2; i >= 0; i--) {
+				suffix[i] = suffix[i+1];
+				suffix[i].group_with(entry_list[i].get_mbr());
+			}
+			for (int k = 0; k < dist_num; k++) {
+				int cut = min_fill + k;
+				margin += prefix[cut-1].get_margin() + suffix[cut].get_margin();
+			}
+		}
+		if (d == 0 || margin < best_margin) {
+			best_axis = d;
+			best_margin = margin;
+		}
+	}
+
+	int best_sort = 0, best_cut = min_fill;
+	double best_overlap = 0, best_area = 0;
+	for (int by_high = 0; by_high < 2; by_high++) {
+		sort(entry_list, entry_list + len, EdgeLess<D>(best_axis, by_high != 0));
+		prefix[0] = entry_list[0].get_mbr();
+		for (int i = 1; i < len; i++) {
+			prefix[i] = prefix[i-1];
+			prefix[i].group_with(entry_list[i].get_mbr());
+		}
+		suffix[len-1] = entry_list[len-1].get_mbr();
+		for (int i = len - 2; i >= 0; i--) {
+			suffix[i] = suffix[i+1];
+			suffix[i].group_with(entry_list[i].get_mbr());
+		}
+		for (int k = 0; k < dist_num; k++) {
+			int cut = min_fill + k;
+			double overlap = prefix[cut-1].get_overlap(suffix[cut]);
+			double cur_area = (double)prefix[cut-1].get_area() + suffix[cut].get_area();
+			if ((by_high == 0 && k == 0) || overlap < best_overlap
+				|| (overlap == best_overlap && cur_area < best_area)) {
+				best_sort = by_high;
+				best_cut = cut;
+				best_overlap = overlap;
+				best_area = cur_area;
+			}
+		}
+	}
+
+	sort(entry_list, entry_list + len, EdgeLess<D>(best_axis, best_sort != 0));
+	node->entry_num = 0;
+	for (int i = 0; i < best_cut; i++) {
+		node->add_entry(entry_list[i]);
+	}
+	for (int i = best_cut; i < len; i++) {
+		new_node->add_entry(entry_list[i]);
+	}
+	old_mbr = get_mbr(node->entries, node->entry_num);
+	new_mbr = get_mbr(new_node->entries, new_node->entry_num);
+}
+
+
+//
+// Quadratic split: seed the two nodes with the pair of entries wasting the most area,
+// then repeatedly assign the entry with the strongest preference for one node.
+// Each node receives at least len - (max_entry_num / 2 + 1) entries, as with linear_split().
+// Return: the MBRs of the two nodes in ``old_mbr'' and ``new_mbr''.
+//
+template <int D>
+void RTree<D>::quadratic_split(Entry<D>* entry_list, int len, RTNode<D>* node, RTNode<D>* new_node, BoundingBox<D>& old_mbr, BoundingBox<D>& new_mbr)
+{
+	int min_fill = len - (max_entry_num / 2 + 1);
+	int m1 = 0, m2 = 1;
+	double max_waste = 0;
+	for (int i = 0; i < len; i++) {
+		for (int j = i + 1; j < len; j++) {
+			BoundingBox<D> mbr = entry_list[i].get_mbr();
+			mbr.group_with(entry_list[j].get_mbr());
+			double waste = (double)area(mbr) - area(entry_list[i].get_mbr()) - area(entry_list[j].get_mbr());
+			if ((i == 0 && j == 1) || waste > max_waste) {
+				m1 = i;
+				m2 = j;
+				max_waste = waste;
+			}
+		}
+	}
+
+	node->set_entry(0, entry_list[m1]);
+	node->entry_num = 1;
+	new_node->add_entry(entry_list[m2]);
+	old_mbr = entry_list[m1].get_mbr();
+	new_mbr = entry_list[m2].get_mbr();
+	// move the seeds to the end of the list; [0, remain) are unassigned.
+	swap_entry(entry_list, m2, len - 1);
+	if (m1 == len - 1) {
+		m1 = m2;
+	}
+	swap_entry(entry_list, m1, len - 2);
+	int remain = len - 2;
+
+	while (remain > 0) {
+		// one node needs all the remaining entries to reach the minimum fill
+		if (node->entry_num + remain <= min_fill || new_node->entry_num + remain <= min_fill) {
+			RTNode<D>* target = node->entry_num + remain <= min_fill ? node : new_node;
+			BoundingBox<D>& target_mbr = target == node ? old_mbr : new_mbr;
+			for (int i = 0; i < remain; i++) {
+				target->add_entry(entry_list[i]);
+				update_mbr(target_mbr, entry_list[i].get_mbr());
+			}
+			break;
+		}
+
+		// PickNext: the entry whose enlargements differ the most
+		int next = 0;
+		double max_diff = -1;
+		int next_old_inc = 0, next_new_inc = 0;
+		for (int i = 0; i < remain; i++) {
+			int old_inc = area_inc(old_mbr, entry_list[i].get_mbr());
+			int new_inc = area_inc(new_mbr, entry_list[i].get_mbr());
+			double diff = fabs((double)old_inc - new_inc);
+			if (diff > max_diff) {
+				next = i;
+				max_diff = diff;
+				next_old_inc = old_inc;
+				next_new_inc = new_inc;
+			}
+		}
+
+		bool add_to_old = false;
+		if (next_old_inc != next_new_inc) // less enlargement better.
+			add_to_old = next_old_inc < next_new_inc;
+		else if (area(old_mbr) != area(new_mbr)) // smaller area better.
+			add_to_old = area(old_mbr) < area(new_mbr);
+		else if (node->entry_num != new_node->entry_num) // fewer entries num better.
+			add_to_old = node->entry_num < new_node->entry_num;
+		else
+			add_to_old = tie_breaking(old_mbr, new_mbr);
+
+		if (add_to_old) {
+			node->add_entry(entry_list[next]);
+			update_mbr(old_mbr, entry_list[next].get_mbr());
+		}
+		else {
+			new_node->add_entry(entry_list[next]);
+			update_mbr(new_mbr, entry_list[next].get_mbr());
+		}
+		remain--;
+		swap_entry(entry_list, next, remain);
+	}
+}
+
+
+//
+// Exhaustive split: try every distribution of the entries that respects the fill of
+// linear_split() and keep the one with the least total area, then the least overlap.
+// The search is exponential, so lists longer than MAX_EXHAUSTIVE_SPLIT use quadratic_split().
+// Return: the MBRs of the two nodes in ``old_mbr'' and ``new_mbr''.
+//
+template <int D>
+void RTree<D>::exhaustive_split(Entry<D>* entry_list, int len, RTNode<D>* node, RTNode<D>* new_node, BoundingBox<D>& old_mbr, BoundingBox<D>& new_mbr)
+{
+	if (len > MAX_EXHAUSTIVE_SPLIT) {
+		quadratic_split(entry_list, len, node, new_node, old_mbr, new_mbr);
+		return;
+	}
+
+	int min_fill = len - (max_entry_num / 2 + 1);
+	// entry 0 always stays in ``node'', which halves the search.
+	unsigned int best_mask = 0;
+	double best_area = 0, best_overlap = 0;
+	for (unsigned int mask = 1; mask < (1u << len); mask += 2) {
+		int cnt = __builtin_popcount(mask);
+		if (cnt < min_fill || len - cnt < min_fill)
+			continue;
+		BoundingBox<D> in_mbr = entry_list[0].get_mbr();
+		BoundingBox<D> out_mbr;
+		bool out_empty = true;
+		for (int i = 1; i < len; i++) {
+			if (mask & (1u << i)) {
+				in_mbr.group_with(entry_list[i].get_mbr());
+			}
+			else if (out_empty) {
+				out_mbr = entry_list[i].get_mbr();
+				out_empty = false;
+			}
+			else {
+				out_mbr.group_with(entry_list[i].get_mbr());
+			}
+		}
+		double cur_area = (double)area(in_mbr) + area(out_mbr);
+		double overlap = in_mbr.get_overlap(out_mbr);
+		if (best_mask == 0 || cur_area < best_area
+			|| (cur_area == best_area && overlap < best_overlap)) {
+			best_mask = mask;
+			best_area = cur_area;
+			best_overlap = overlap;
+		}
+	}
+
+	node->entry_num = 0;
+	for (int i = 0; i < len; i++) {
+		if (best_mask & (1u << i))
+			node->add_entry(entry_list[i]);
+		else
+			new_node->add_entry(entry_list[i]);
+	}
+	old_mbr = get_mbr(node->entries, node->entry_num);
+	new_mbr = get_mbr(new_node->entries, new_node->entry_num);
+}
+
+
+//
+// Split the max_entry_num + 1 entries of ``entry_list'' between ``node'' and ``new_node''
+// with the split method of the tree.
+// Return: the MBRs of the two nodes in ``old_mbr'' and ``new_mbr''.
+//
+template <int D>
+void RTree<D>::split_node(Entry<D>* entry_list, RTNode<D>* node, RTNode<D>* new_node, BoundingBox<D>& old_mbr, BoundingBox<D>& new_mbr)
+{
+	switch (split_method) {
+		case QUADRATIC_SPLIT:
+			quadratic_split(entry_list, max_entry_num + 1, node, new_node, old_mbr, new_mbr);
+			break;
+		case RSTAR_SPLIT:
+			rstar_split(entry_list, max_entry_num + 1, node, new_node, old_mbr, new_mbr);
+			break;
+		case EXHAUSTIVE_SPLIT:
+			exhaustive_split(entry_list, max_entry_num + 1, node, new_node, old_mbr, new_mbr);
+			break;
+		default:
+			linear_split(entry_list, node, new_node, old_mbr, new_mbr);
+	}
+}
+
+
+//
+// R* forced reinsertion: copy the ``reinsert_num'' entries of ``entry_list'' whose centers
+// lie farthest from the center of the node's MBR to ``removed'' (farthest first)
+// and keep the others in ``node''.
+//
+template <int D>
+void RTree<D>::pick_reinsert(Entry<D>* entry_list, int len, RTNode<D>* node, int reinsert_num, vector<Entry<D> >& removed)
+{
+	BoundingBox<D> mbr = get_mbr(entry_list, len);
+	vector<pair<double, int> >& dist = reinsert_order;
+	dist.resize(len);
+	for (int i = 0; i < len; i++) {
+		const BoundingBox<D>& cur = entry_list[i].get_mbr();
+		double d2 = 0;
+		for (int d = 0; d < dimension; d++) {
+			double diff = ((double)cur.get_lowestValue_at(d) + cur.get_highestValue_at(d)
+				- mbr.get_lowestValue_at(d) - mbr.get_highestValue_at(d)) / 2;
+			d2 += diff * diff;
+		}
+		dist[i] = make_pair(-d2, i);
+	}
+	sort(dist.begin(), dist.end());
+
+	removed.resize(reinsert_num);
+	node->entry_num = 0;
+	for (int i = 0; i < len; i++) {
+		if (i < reinsert_num)
+			removed[i] = entry_list[dist[i].second];
+		else
+			node->add_entry(entry_list[dist[i].second]);
+	}
+}
+
+
+//
+// Size the scratch buffers of insert() and del() for the current height of the tree.
+//
+template <int D>
+void RTree<D>::grow_scratch()
+{
+	int height = root->level + 1;
+	if ((int)path_stack.size() < height) {
+		path_stack.resize(height);
+		path_idx.resize(height);
+		condensed.resize(height);
+		reinsert_buffer.resize(height);
+		flush_buffer.resize(height);
+		copy_stack.resize(height);
+		copy_idx.resize(height);
+	}
+	if ((int)split_buffer.size() < max_entry_num + 1) {
+		split_buffer.resize(max_entry_num + 1);
+	}
+}
+
+
+//
+// Adjust the MBR of nodes involved in insertion.
+//
+template <int D>
+void RTree<D>::adjust_tree(RTNode<D>** stack, int* entry_idx, int size)
+{
+	while (size > 0) {
+		size--;
+		RTNode<D>* node = stack[size]->entries[entry_idx[size]].get_ptr();
+		BoundingBox<D> mbr = get_mbr(node->entries, node->entry_num);
+		if (!node->buffer.empty())
+			mbr.group_with(node->buffer_mbr);
+		stack[size]->set_entry_mbr(entry_idx[size], mbr);
+	}
+}
+
+
+//
+// Helper function for query_range(), with range specified in ``mbr''.
+// Return: number of results in ``result_cnt''.
+//		number of R-tree nodes traveled in ``node_traveled''.
+template <int D>
+void RTree<D>::query_range(const RTNode<D>* node, const BoundingBox<D>& mbr, int& result_cnt, int& node_traveled) const
+{
+	node_traveled++;
+	for (size_t i = 0; i < node->buffer.size(); i++) {
+		if (node->buffer[i].get_mbr().is_intersected(mbr))
+			result_cnt++;
+	}
+	// test the whole node at once, 64 entries per mask.
+	for (int base = 0; base < node->entry_num; base += 64) {
+		unsigned long long hits = node->intersect_mask(mbr, base);
+		if (node->level == 0) {
+			result_cnt += __builtin_popcountll(hits);
+			// tombstones are rare: take them back off. The count belongs to the writer in snapshot mode.
+			for (; (snapshots || tombstone_cnt > 0) && hits != 0; hits &= hits - 1) {
+				if (node->entries[base + __builtin_ctzll(hits)].is_deleted())
+					result_cnt--;
+			}
+		} else {
+			while (hits != 0) {
+				int i = base + __builtin_ctzll(hits);
+				hits &= hits - 1;
+				query_range(node->entries[i].get_ptr(), mbr, result_cnt, node_traveled);
+			}
+		}
+	}
+}
+
+
+//
+// Helper function for the visitor form of query_range().
+// Return false if ``visitor'' stopped the query.
+//
+template <int D>
+bool RTree<D>::query_range(const RTNode<D>* node, const BoundingBox<D>& mbr, EntryVisitor<D>& visitor, int& node_traveled) const
+{
+	node_traveled++;
+	for (size_t i = 0; i < node->buffer.size(); i++) {
+		if (node->buffer[i].get_mbr().is_intersected(mbr) && !visitor.visit(node->buffer[i]))
+			return false;
+	}
+	for (int base = 0; base < node->entry_num; base += 64) {
+		unsigned long long hits = node->intersect_mask(mbr, base);
+		while (hits != 0) {
+			int i = base + __builtin_ctzll(hits);
+			hits &= hits - 1;
+			if (node->level == 0) {
+				if (!node->entries[i].is_deleted() && !visitor.visit(node->entries[i]))
+					return false;
+			}
+			else if (!query_range(node->entries[i].get_ptr(), mbr, visitor, node_traveled)) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+
+//
+// Helper function for query_range_batch(): search ``node'' for the queries ``boxes[active[0..active_num-1]]''.
+// All of them are tested against the entries of the node at once, and each child is entered
+// with the queries it intersects. ``masks'' and ``lists'' are scratch buffers, one per level.
+//
+template <int D>
+void RTree<D>::query_batch(const RTNode<D>* node, const BoundingBox<D>* boxes, const int* active, int active_num, vector<vector<Entry<D> > >& results,
+	int& node_traveled, vector<vector<unsigned long long> >& masks, vector<vector<int> >& lists) const
+{
+	node_traveled++;
+	for (size_t i = 0; i < node->buffer.size(); i++) {
+		for (int a = 0; a < active_num; a++) {
+			if (node->buffer[i].get_mbr().is_intersected(boxes[active[a]]))
+				results[active[a]].push_back(node->buffer[i]);
+		}
+	}
+	int words = (node->entry_num + 63) / 64;
+	vector<unsigned long long>& mask = masks[node->level];
+	if ((int)mask.size() < active_num * words)
+		mask.resize(active_num * words);
+	for (int a = 0; a < active_num; a++) {
+		for (int w = 0; w < words; w++)
+			mask[a * words + w] = node->intersect_mask(boxes[active[a]], w * 64);
+	}
+
+	if (node->level == 0) {
+		for (int a = 0; a < active_num; a++) {
+			vector<Entry<D> >& found = results[active[a]];
+			for (int w = 0; w < words; w++) {
+				for (unsigned long long hits = mask[a * words + w]; hits != 0; hits &= hits - 1) {
+					const Entry<D>& e = node->entries[w * 64 + __builtin_ctzll(hits)];
+					if (!e.is_deleted())
+						found.push_back(e);
+				}
+			}
+		}
+		return;
+	}
+	// bucket the queries by child: the queries of child i are at list[list[i]..list[i+1]-1].
+	int n = node->entry_num;
+	vector<int>& list = lists[node->level];
+	list.assign(n + 2, 0);
+	for (int a = 0; a < active_num; a++) {
+		for (int w = 0; w < words; w++) {
+			for (unsigned long long hits = mask[a * words + w]; hits != 0; hits &= hits - 1)
+				list[w * 64 + __builtin_ctzll(hits) + 2]++;
+		}
+	}
+	list[1] = n + 2;
+	for (int i = 2; i <= n + 1; i++)
+		list[i] += list[i - 1];
+	list.resize(list[n + 1]);
+	for (int a = 0; a < active_num; a++) {
+		for (int w = 0; w < words; w++) {
+			for (unsigned long long hits = mask[a * words + w]; hits != 0; hits &= hits - 1)
+				list[list[w * 64 + __builtin_ctzll(hits) + 1]++] = active[a];
+		}
+	}
+	list[0] = n + 2;
+	for (int i = 0; i < n; i++) {
+		if (list[i + 1] > list[i])
+			query_batch(node->entries[i].get_ptr(), boxes, &list[list[i]], list[i + 1] - list[i], results, node_traveled, masks, lists);
+	}
+}
+
+
+//
+// Squared distance between the nearest points of ``mbr1'' and ``mbr2'', 0 if they intersect.
+//
+template <int D>
+static double get_mindist(const BoundingBox<D>& mbr1, const BoundingBox<D>& mbr2)
+{
+	const int* low1 = mbr1.get_lowest();
+	const int* high1 = mbr1.get_highest();
+	const int* low2 = mbr2.get_lowest();
+	const int* high2 = mbr2.get_highest();
+	double dist = 0;
+	for (int d = 0; d < mbr1.get_dim(); d++) {
+		double diff = 0;
+		if (high1[d] < low2[d])
+			diff = (double)low2[d] - high1[d];
+		else if (high2[d] < low1[d])
+			diff = (double)low1[d] - high2[d];
+		dist += diff * diff;
+	}
+	return dist;
+}
+
+
+//
+// ``mbr'' grown by ``eps'' on every side, within the range of int.
+//
+template <int D>
+static BoundingBox<D> expand(const BoundingBox<D>& mbr, int eps)
+{
+	if (eps == 0)
+		return mbr;
+	static thread_local vector<int> bounds;
+	int dim = mbr.get_dim();
+	bounds.resize(2 * dim);
+	for (int d = 0; d < dim; d++) {
+		bounds[d] = max((long long)mbr.get_lowestValue_at(d) - eps, (long long)INT_MIN);
+		bounds[dim + d] = min((long long)mbr.get_highestValue_at(d) + eps, (long long)INT_MAX);
+	}
+	return BoundingBox<D>(&bounds[0], &bounds[dim], dim);
+}
+
+
+//
+// Return true if ``e1'' and ``e2'' are within distance ``eps'', or intersect if it is 0.
+//
+template <int D>
+static bool is_near(const Entry<D>& e1, const Entry<D>& e2, int eps)
+{
+	if (eps == 0)
+		return e1.get_mbr().is_intersected(e2.get_mbr());
+	return get_mindist(e1.get_mbr(), e2.get_mbr()) <= (double)eps * eps;
+}
+
+
+//
+// Helper function for join(): the entries of ``node'' reaching ``mbr'' (all of them if it
+// is NULL), leaving out tombstones, in ``list'' by their lowest coordinate on the first dimension.
+//
+template <int D>
+void RTree<D>::sweep_list(const RTNode<D>* node, const BoundingBox<D>* mbr, vector<pair<int, int> >& list) const
+{
+	list.clear();
+	for (int base = 0; base < node->entry_num; base += 64) {
+		int n = min(64, node->entry_num - base);
+		unsigned long long hits = mbr != NULL ? node->intersect_mask(*mbr, base) : (n == 64 ? ~0ULL : (1ULL << n) - 1);
+		for (; hits != 0; hits &= hits - 1) {
+			int i = base + __builtin_ctzll(hits);
+			if (node->level != 0 || !node->entries[i].is_deleted())
+				list.push_back(make_pair(node->entries[i].get_mbr().get_lowestValue_at(0), i));
+		}
+	}
+	sort(list.begin(), list.end());
+}
+
+
+//
+// Helper function for join(): report the intersecting records below ``node1'' and ``node2''.
+// Only the entries reaching the other node take part, and these are matched by a plane sweep
+// along the first dimension. A node higher than the other one is descended alone.
+// Return false if the visitor stopped the join.
+//
+template <int D>
+bool RTree<D>::join(const RTNode<D>* node1, const BoundingBox<D>* mbr1, const RTNode<D>* node2, const BoundingBox<D>* mbr2, JoinState& state) const
+{
+	if (state.stopped->load(memory_order_relaxed))
+		return false;
+	int depth = node1->level + node2->level;
+	// with a distance, the entries of each node are those reaching the other node grown by it.
+	const BoundingBox<D>* reach1 = mbr1;
+	const BoundingBox<D>* reach2 = mbr2;
+	BoundingBox<D> grown1, grown2;
+	if (state.eps != 0 && mbr1 != NULL)
+		reach1 = &(grown1 = expand(*mbr1, state.eps));
+	if (state.eps != 0 && mbr2 != NULL)
+		reach2 = &(grown2 = expand(*mbr2, state.eps));
+	if (node1->level != node2->level) {
+		bool first = node1->level > node2->level;
+		const RTNode<D>* node = first ? node1 : node2;
+		vector<pair<int, int> >& list = state.sweep[2 * depth];
+		sweep_list(node, first ? reach2 : reach1, list);
+		state.node_travelled++;
+		for (size_t k = 0; k < list.size(); k++) {
+			const Entry<D>& e = node->entries[list[k].second];
+			JoinPair pair = first ? JoinPair{e.get_ptr(), &e.get_mbr(), node2, mbr2} : JoinPair{node1, mbr1, e.get_ptr(), &e.get_mbr()};
+			if (state.deferred != NULL)
+				state.deferred->push_back(pair);
+			else if (!join(pair.node1, pair.mbr1, pair.node2, pair.mbr2, state))
+				return false;
+		}
+		return true;
+	}
+
+	state.node_travelled += 2;
+	vector<pair<int, int> >& list1 = state.sweep[2 * depth];
+	vector<pair<int, int> >& list2 = state.sweep[2 * depth + 1];
+	sweep_list(node1, reach2, list1);
+	sweep_list(node2, reach1, list2);
+	auto match = [&](const Entry<D>& e1, const Entry<D>& e2) {
+		if (!is_near(e1, e2, state.eps))
+			return true;
+		if (node1->level == 0) {
+			if (state.visitor->visit(e1, e2))
+				return true;
+			state.stopped->store(true);
+			return false;
+		}
+		if (state.deferred == NULL)
+			return join(e1.get_ptr(), &e1.get_mbr(), e2.get_ptr(), &e2.get_mbr(), state);
+		state.deferred->push_back(JoinPair{e1.get_ptr(), &e1.get_mbr(), e2.get_ptr(), &e2.get_mbr()});
+		return true;
+	};
+	// the entry starting first is matched with the entries of the other node starting before its end, plus eps.
+	size_t i = 0, j = 0;
+	while (i < list1.size() && j < list2.size()) {
+		if (list1[i].first <= list2[j].first) {
+			const Entry<D>& e1 = node1->entries[list1[i].second];
+			long long end = (long long)e1.get_mbr().get_highestValue_at(0) + state.eps;
+			for (size_t k = j; k < list2.size() && list2[k].first <= end; k++) {
+				if (!match(e1, node2->entries[list2[k].second]))
+					return false;
+			}
+			i++;
+		} else {
+			const Entry<D>& e2 = node2->entries[list2[j].second];
+			long long end = (long long)e2.get_mbr().get_highestValue_at(0) + state.eps;
+			for (size_t k = i; k < list1.size() && list1[k].first <= end; k++) {
+				if (!match(node1->entries[list1[k].second], e2))
+					return false;
+			}
+			j++;
+		}
+	}
+	return true;
+}
+
+
+//
+// Helper function for join(): report the leaf records below ``node'' paired with the record ``e'',
+// with ``e'' first in each pair if ``left''. ``reach'' is the MBR of ``e'' grown by the distance.
+//
+template <int D>
+bool RTree<D>::join_entry(const Entry<D>& e, const BoundingBox<D>& reach, const RTNode<D>* node, bool left, JoinState& state) const
+{
+	state.node_travelled++;
+	for (int base = 0; base < node->entry_num; base += 64) {
+		for (unsigned long long hits = node->intersect_mask(reach, base); hits != 0; hits &= hits - 1) {
+			const Entry<D>& found = node->entries[base + __builtin_ctzll(hits)];
+			if (node->level != 0) {
+				if (!join_entry(e, reach, found.get_ptr(), left, state))
+					return false;
+			}
+			else if (!found.is_deleted() && is_near(e, found, state.eps)
+				&& !(left ? state.visitor->visit(e, found) : state.visitor->visit(found, e))) {
+				state.stopped->store(true);
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+
+template <int D>
+void RTree<D>::gather_buffers(const RTNode<D>* node, vector<Entry<D> >& records) const
+{
+	if (node->level == 0)
+		return;
+	records.insert(records.end(), node->buffer.begin(), node->buffer.end());
+	for (int i = 0; i < node->entry_num; i++)
+		gather_buffers(node->entries[i].get_ptr(), records);
+}
+
+
+//
+// Helper function for join(): the pairs with a record still in a node buffer, which the
+// node traversal leaves out. ``root1'' and ``root2'' are the roots of this tree and ``other''.
+//
+template <int D>
+bool RTree<D>::join_buffers(const RTNode<D>* root1, const RTree<D>& other, const RTNode<D>* root2, JoinState& state) const
+{
+	if (buffered_cnt == 0 && other.buffered_cnt == 0)
+		return true;
+	vector<Entry<D> > buffered1, buffered2;
+	gather_buffers(root1, buffered1);
+	other.gather_buffers(root2, buffered2);
+	for (size_t i = 0; i < buffered1.size(); i++) {
+		if (!join_entry(buffered1[i], expand(buffered1[i].get_mbr(), state.eps), root2, true, state))
+			return false;
+	}
+	for (size_t i = 0; i < buffered2.size(); i++) {
+		if (!join_entry(buffered2[i], expand(buffered2[i].get_mbr(), state.eps), root1, false, state))
+			return false;
+	}
+	for (size_t i = 0; i < buffered1.size(); i++) {
+		for (size_t j = 0; j < buffered2.size(); j++) {
+			if (is_near(buffered1[i], buffered2[j], state.eps) && !state.visitor->visit(buffered1[i], buffered2[j])) {
+				state.stopped->store(true);
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+
+//
+// Helper function for self_join(): report the pairs within the distance below ``node''.
+// Each pair of entries of the node is taken once, by a plane sweep; two children within
+// the distance are joined as a pair of nodes, then each child with itself.
+//
+template <int D>
+bool RTree<D>::self_join(const RTNode<D>* node, JoinState& state) const
+{
+	if (state.stopped->load(memory_order_relaxed))
+		return false;
+	state.node_travelled++;
+	// join() keeps the second node of a pair on this level here, but such pairs are joined
+	// only by the parent, before it descends.
+	vector<pair<int, int> >& list = state.sweep[4 * node->level + 1];
+	sweep_list(node, NULL, list);
+	for (size_t i = 0; i < list.size(); i++) {
+		const Entry<D>& e1 = node->entries[list[i].second];
+		long long end = (long long)e1.get_mbr().get_highestValue_at(0) + state.eps;
+		for (size_t k = i + 1; k < list.size() && list[k].first <= end; k++) {
+			const Entry<D>& e2 = node->entries[list[k].second];
+			if (!is_near(e1, e2, state.eps))
+				continue;
+			if (node->level != 0) {
+				if (!join(e1.get_ptr(), &e1.get_mbr(), e2.get_ptr(), &e2.get_mbr(), state))
+					return false;
+			}
+			else if (!state.visitor->visit(e1, e2)) {
+				state.stopped->store(true);
+				return false;
+			}
+		}
+	}
+	if (node->level != 0) {
+		for (size_t i = 0; i < list.size(); i++) {
+			if (!self_join(node->entries[list[i].second].get_ptr(), state))
+				return false;
+		}
+	}
+	return true;
+}
+
+
+//
+// Helper function for point_query().
+//
+template <int D>
+bool RTree<D>::query_point(const RTNode<D>* node, const BoundingBox<D>& mbr, Entry<D>& result) const
+{
+	for (size_t i = 0; i < node->buffer.size(); i++) {
+		if (node->buffer[i].get_mbr().is_intersected(mbr)) {
+			result = node->buffer[i];
+			return true;
+		}
+	}
+	for (int base = 0; base < node->entry_num; base += 64) {
+		unsigned long long hits = node->intersect_mask(mbr, base);
+		while (hits != 0) {
+			int i = base + __builtin_ctzll(hits);
+			hits &= hits - 1;
+			if (node->level == 0) {
+				if (node->entries[i].is_deleted())
+					continue;
+				result = node->entries[i];
+				return true;
+			}
+			if (query_point(node->entries[i].get_ptr(), mbr, result)) {
+				return true;
+			}
+		}
+	}
+	return false;
+}	
+
+
+template <int D>
+bool RTree<D>::insert(const vector<int>& coordinate, int rid)
+{
+	if (coordinate.size() != this->dimension)
+	{
+		cerr << "R-tree dimensionality inconsistency\n";
+	}
+	//a point is also modeled by a mbr.
+	BoundingBox<D> mbr(coordinate, coordinate);
+	Entry<D> e(mbr, rid);
+	if (buffer_size > 0 && root->level > 0) {
+		push_buffer(root, e);
+		while (root->level > 0 && (int)root->buffer.size() >= buffer_size)
+			flush_node(root);
+		return true;
+	}
+	reinserted.assign(root->level + 1, false);
+	return insert(e, 0);
+}
+
+
+//
+// Insert a record with key ``coordinate'', or give the record already stored
+// under that key the record id ``rid''.
+// Return: true if a record was inserted, false if an existing one was updated.
+//
+template <int D>
+bool RTree<D>::upsert(const vector<int>& coordinate, int rid)
+{
+	flush();
+	if ((int)coordinate.size() != this->dimension)
+	{
+		cerr << "R-tree dimensionality inconsistency\n";
+		return false;
+	}
+	BoundingBox<D> mbr(coordinate, coordinate);
+	Entry<D> e(mbr, rid);
+	reinserted.assign(root->level + 1, false);
+	return insert(e, 0, true, true, 0);
+}
+
+
+//
+// Helper function for insertion. Buffered insertion does not look for duplicates.
+//
+template <int D>
+bool RTree<D>::insert(const Entry<D>& e, int dest_level)
+{
+	return insert(e, dest_level, false, buffer_size == 0, 0);
+}
+
+
+//
+// Helper function for insertion. If ``check_dup'' is set, a record whose key is already
+// in the tree is not inserted; its rid is replaced by the one of ``e'' if ``replace'' is set.
+// The descent starts below the first ``prefix'' nodes of the path kept in path_stack.
+// Return: whether ``e'' was added to the tree.
+//
+template <int D>
+bool RTree<D>::insert(const Entry<D>& e, int dest_level, bool replace, bool check_dup, int prefix)
+{
+	grow_scratch();
+	// stack contains the path to the leaf (not including the leaf node).
+	RTNode<D>** stack = &path_stack[0];
+	int stack_size = prefix;
+	// entry_idx contains the index of each entry in the node from the path.
+	int* entry_idx = &path_idx[0];
+
+	RTNode<D>* dup_leaf;
+	int dup_idx;
+	RTNode<D>* leaf = choose_leaf(stack, entry_idx, stack_size, e, dest_level, replace || check_dup, dup_leaf, dup_idx);
+	if (leaf == NULL) {
+		if (replace || dup_leaf->entries[dup_idx].is_deleted())
+			dup_leaf = own_leaf(dup_leaf, e.get_mbr());
+		if (revive(dup_leaf, dup_idx, e))
+			return true;
+		if (replace) {
+			if (use_locator) {
+				locator.erase(dup_leaf->entries[dup_idx].get_rid());
+				locator[e.get_rid()] = dup_leaf;
+			}
+			dup_leaf->entries[dup_idx].set_rid(e.get_rid());
+		}
+		return false;
+	}
+	leaf = own_path(stack, entry_idx, stack_size, leaf);
+	
+	// check if there is space for the new entry
+	if (leaf->entry_num < max_entry_num) {
+		leaf->add_entry(e);//pointer
+		if (use_locator && dest_level == 0 && !e.is_deleted())
+			locator[e.get_rid()] = leaf;
+		/*if (stack_size != 0)
+		{
+			this->print_node(stack[0],4);
+		}	*/
+		adjust_tree(stack, entry_idx, stack_size);
+		/*if (stack_size != 0)
+		{
+			this->print_node(stack[0],4);
+		}	*/
+		return true;
+	}
+
+	
+	// split is needed.
+	bool split = true;
+	RTNode<D>* node = leaf;
+	Entry<D> new_entry = e;
+	while (split) {
+		Entry<D>* entry_buffer = &split_buffer[0];
+		for (int i = 0; i < node->entry_num; i++) {
+			entry_buffer[i] = node->entries[i];
+		}
+		entry_buffer[max_entry_num] = new_entry;
+
+		if (insert_mode == RSTAR_INSERT && (int)reinserted.size() <= node->level)
+			reinserted.resize(node->level + 1, false);
+		if (insert_mode == RSTAR_INSERT && stack_size > 0 && !reinserted[node->level]) {
+			// R*: the first overflow on a level reinserts the entries farthest
+			// from the node center instead of splitting.
+			reinserted[node->level] = true;
+			int level = node->level;
+			int reinsert_num = max(1, max_entry_num * 3 / 10);
+			// the nested insertions reuse the scratch buffers, so the entries wait
+			// in the buffer of their level, which reinserts at most once.
+			pick_reinsert(entry_buffer, max_entry_num + 1, node, reinsert_num, reinsert_buffer[level]);
+			locate(node);
+			adjust_tree(stack, entry_idx, stack_size);
+			// closest first
+			for (int i = reinsert_num - 1; i >= 0; i--) {
+				insert(reinsert_buffer[level][i], level);
+			}
+			return true;
+		}
+
+		RTNode<D>* new_node = node_pool->alloc(node->level);
+		BoundingBox<D> old_mbr, new_mbr;
+		split_node(entry_buffer, node, new_node, old_mbr, new_mbr);
+		locate(node);
+		locate(new_node);
+		if (!node->buffer.empty())
+			share_buffer(node, new_node, old_mbr, new_mbr);
+
+		// two nodes now. go to a higher level
+		if (stack_size == 0) {
+			// root reached.
+			RTNode<D>* new_root = node_pool->alloc(node->level+1);
+			new_root->set_entry_mbr(0, old_mbr);
+			new_root->entries[0].set_ptr(node);
+			new_root->set_entry_mbr(1, new_mbr);
+			new_root->entries[1].set_ptr(new_node);
+			new_root->entry_num = 2;
+			root = new_root;
+			split = false;
+		}
+		else {
+			stack_size--;
+			RTNode<D>* parent = stack[stack_size];
+			int idx = entry_idx[stack_size];
+			parent->set_entry_mbr(idx, old_mbr);
+			new_entry.set_mbr(new_mbr);
+			new_entry.set_ptr(new_node);
+			if (parent->entry_num < max_entry_num) {
+				parent->add_entry(new_entry);
+				split = false;
+			}
+			else
+				node = parent;
+		}
+	}
+	adjust_tree(stack, entry_idx, stack_size);
+
+	return true;
+}
+
+
+//
+// Condense tree due to deletion of nodes.
+//
+template <int D>
+void RTree<D>::condense_tree(RTNode<D>** stack, int* entry_idx, int size)
+{
+	int size_before_mod = size;
+
+	// indexed rather than held by pointer: the reinsertions below may grow it.
+	vector<RTNode<D>*>& deleted_stack = condensed;
+	int deleted_size = 0;
+
+	while (size > 0) {
+		size--;
+		RTNode<D>* node = stack[size]->entries[entry_idx[size]].get_ptr();
+		int m = max_entry_num/2 + 1;
+		if (node->entry_num < m){
+			// 1. remove this from the parent node
+			stack[size]->remove_entry(entry_idx[size]); // move the record the the end to indicate ``deleted''
+			//2. insert the node into deleted_stack
+			deleted_stack[deleted_size++] = node;
+		}
+	}
+	//adjustment the mbr of the tree affect due to deletion of nodes
+	adjust_tree(stack,entry_idx,size_before_mod);
+	if (root->entry_num == 0 && deleted_size > 0) {
+		// the last child of the root went: the root takes the level of the tallest removed node.
+		root->level = deleted_stack[deleted_size-1]->level;
+	}
+	//then do the insertion
+	while(deleted_size>0){
+		deleted_size--;
+		RTNode<D>* deleted_node = deleted_stack[deleted_size];
+
+		// (bubble) sort the entries in the remaining set
+    	for (int j = 0; j < deleted_node->entry_num-1; j++) {
+        	if (tie_breaking(deleted_node->entries[j].get_mbr(), deleted_node->entries[j+1].get_mbr())) {
+        			swap_entry(deleted_node->entries, j, j+1);
+       		}
+     	}
+
+		//re-insertion according to the order
+		for(int i=0;i<deleted_node->entry_num;++i){
+			insert(deleted_node->entries[i],deleted_node->level);
+		}
+		free_node(deleted_node);
+	}
+	while (root->entry_num==1 && root->level != 0) {
+		RTNode<D>* old_root = root;
+		root = root->entries[0].get_ptr();
+		free_node(old_root);
+	}
+
+}
+
+
+template <int D>
+bool RTree<D>::del(const vector<int>& coordinate)
+{
+	flush();
+	if ((int)coordinate.size() != this->dimension)
+	{
+		cerr << "R-tree dimensionality inconsistency\n";
+		return false;
+	}
+	/*
+	Add your code here
+	*/
+	BoundingBox<D> mbr(coordinate,coordinate);
+	Entry<D> e(mbr, 0);//dummy rid to be 0
+	if (lazy_delete) {
+		RTNode<D>* leaf;
+		int idx;
+		if (!find_entry(root, mbr, true, leaf, idx))
+			return false;
+		bury(own_leaf(leaf, mbr), idx);
+		check_compact();
+		return true;
+	}
+//RTNode<D>* RTree::find_leaf(RTNode<D>* node, RTNode<D>** stack, int* entry_idx, int& stack_size, const Entry<D>& record)
+
+	grow_scratch();
+	RTNode<D>** stack = &path_stack[0];
+    int stack_size = 0;
+    	// entry_idx contains the index of each entry in the node from the path.
+   	int* entry_idx = &path_idx[0];
+    //find the leaf node containing the target entry and remove the entry from the node.if NULL, the entry doesnt exist
+   	RTNode<D>* leaf = find_leaf(root,stack, entry_idx, stack_size, e);
+	if(leaf==NULL){//the entry does not exist
+		return false;
+	}
+//	else if(leaf->level==level){//it is the root
+//	//update the mbr first and then do the re-insertion of all its entries
+//		leaf->set_mbr(get_mbr(leaf->entries,leaf->entry_num));
+//    	// (bubble) sort the entries in the remaining set
+//       	for (int j = 0; j < leaf->entry_num-1; j++) {
+//           	if (tie_breaking(leaf->entries[j].get_mbr(), leaf->entries[j+1].get_mbr())) {
+//           			swap_entry(leaf->entries, j, j+1);
+//           	}
+//       	}
+//
+//    		//re-insertion according to the order
+//    		for(int i=0;i<leaf->entry_num;++i){
+//    			insert(leaf->entries[i],leaf->level);
+//    		}
+//    	}
+//	}else{
+		remove_record(leaf, stack, entry_idx, stack_size);
+
+
+
+
+    return true;
+}
+
+
+//
+// Finish the deletion of the record just moved behind the last entry of ``leaf'':
+// drop it from the locator and condense the tree along the path to ``leaf''.
+//
+template <int D>
+void RTree<D>::remove_record(RTNode<D>* leaf, RTNode<D>** stack, int* entry_idx, int stack_size)
+{
+	if (use_locator) {
+		int rid = leaf->entries[leaf->entry_num].get_rid();
+		typename unordered_map<int, RTNode<D>*>::iterator it = locator.find(rid);
+		if (it != locator.end() && it->second == leaf)
+			locator.erase(it);
+	}
+	reinserted.assign(root->level + 1, false);
+	condense_tree(stack, entry_idx, stack_size);
+}
+
+
+//
+// Delete the record with key ``coordinate'' and record id ``rid''.
+//
+template <int D>
+bool RTree<D>::del(const vector<int>& coordinate, int rid)
+{
+	flush();
+	if ((int)coordinate.size() != this->dimension)
+	{
+		cerr << "R-tree dimensionality inconsistency\n";
+		return false;
+	}
+	BoundingBox<D> mbr(coordinate, coordinate);
+
+	grow_scratch();
+	RTNode<D>** stack = &path_stack[0];
+	int stack_size = 0;
+	int* entry_idx = &path_idx[0];
+	int idx;
+	RTNode<D>* leaf = locate_record(&mbr, rid, stack, entry_idx, stack_size, idx);
+	if (leaf == NULL)
+		return false;
+	leaf = own_path(stack, entry_idx, stack_size, leaf);
+	if (lazy_delete) {
+		bury(leaf, idx);
+		check_compact();
+		return true;
+	}
+	leaf->remove_entry(idx);
+	remove_record(leaf, stack, entry_idx, stack_size);
+	return true;
+}
+
+
+//
+// Delete the record with record id ``rid'', found through the locator if it is on.
+//
+template <int D>
+bool RTree<D>::del_rid(int rid)
+{
+	flush();
+	grow_scratch();
+	RTNode<D>** stack = &path_stack[0];
+	int stack_size = 0;
+	int* entry_idx = &path_idx[0];
+	int idx;
+	RTNode<D>* leaf = locate_record(NULL, rid, stack, entry_idx, stack_size, idx);
+	if (leaf == NULL)
+		return false;
+	leaf = own_path(stack, entry_idx, stack_size, leaf);
+	if (lazy_delete) {
+		bury(leaf, idx);
+		check_compact();
+		return true;
+	}
+	leaf->remove_entry(idx);
+	remove_record(leaf, stack, entry_idx, stack_size);
+	return true;
+}
+
+
+//
+// Delete a record with each key in ``keys'', as del() does, but condense the tree once:
+// the records are taken out first, then condense_touched() runs over the paths to them.
+// Return: the number of records deleted.
+//
+template <int D>
+int RTree<D>::delete_batch(const vector<vector<int> >& keys)
+{
+	flush();
+	vector<Entry<D> > key_list;
+	key_list.reserve(keys.size());
+	for (size_t i = 0; i < keys.size(); i++) {
+		if ((int)keys[i].size() != this->dimension)
+		{
+			cerr << "R-tree dimensionality inconsistency\n";
+			continue;
+		}
+		key_list.push_back(Entry<D>(BoundingBox<D>(keys[i], keys[i]), 0));
+	}
+	// neighbouring keys share most of their paths.
+	hilbert_sort(key_list);
+
+	int deleted = 0;
+	unordered_set<RTNode<D>*> touched; // nodes on the paths to deleted records
+	for (size_t i = 0; i < key_list.size(); i++) {
+		grow_scratch();
+		RTNode<D>** stack = &path_stack[0];
+		int* entry_idx = &path_idx[0];
+		int stack_size = 0;
+		RTNode<D>* leaf = find_leaf(root, stack, entry_idx, stack_size, key_list[i]);
+		if (leaf == NULL)
+			continue;
+		deleted++;
+		if (use_locator) {
+			typename unordered_map<int, RTNode<D>*>::iterator it = locator.find(leaf->entries[leaf->entry_num].get_rid());
+			if (it != locator.end() && it->second == leaf)
+				locator.erase(it);
+		}
+		touched.insert(leaf);
+		for (int k = 0; k < stack_size; k++)
+			touched.insert(stack[k]);
+	}
+	if (deleted > 0)
+		condense_touched(touched);
+	return deleted;
+}
+
+
+//
+// Remove the nodes in ``touched'' left with fewer than the minimum number of entries
+// in one bottom-up pass, and insert their entries again, subtrees first and records
+// last as one batch in Hilbert order. ``touched'' holds every node on the paths
+// from the root to the nodes that lost entries.
+//
+template <int D>
+void RTree<D>::condense_touched(const unordered_set<RTNode<D>*>& touched)
+{
+	if (root->level == 0)
+		return;
+	vector<vector<Entry<D> > > orphans(root->level + 1);
+	condense_batch(root, touched, orphans);
+	if (root->level > 0 && root->entry_num == 0) {
+		// no child of the root is left: the tallest orphans make the new root.
+		int level = root->level;
+		while (level > 0 && orphans[level].empty())
+			level--;
+		free_node(root);
+		root = node_pool->alloc(level);
+	}
+	for (int level = root->level; level > 0; level--) {
+		for (size_t i = 0; i < orphans[level].size(); i++) {
+			reinserted.assign(root->level + 1, false);
+			insert(orphans[level][i], level);
+		}
+	}
+	insert_batch(orphans[0]);
+	while (root->entry_num == 1 && root->level != 0) {
+		RTNode<D>* old_root = root;
+		root = root->entries[0].get_ptr();
+		free_node(old_root);
+	}
+}
+
+
+//
+// Remove the children of ``node'' in ``touched'' that have fewer than the minimum number of
+// entries, below ``node'' first, and move their entries to ``orphans'' by level. The
+// entries of the other children in ``touched'' are brought up to date.
+//
+template <int D>
+void RTree<D>::condense_batch(RTNode<D>* node, const unordered_set<RTNode<D>*>& touched, vector<vector<Entry<D> > >& orphans)
+{
+	int m = max_entry_num/2 + 1;
+	// backwards, as remove_entry() moves the last entry into the hole.
+	for (int i = node->entry_num - 1; i >= 0; i--) {
+		RTNode<D>* child = node->entries[i].get_ptr();
+		if (touched.find(child) == touched.end())
+			continue;
+		if (child->level > 0)
+			condense_batch(child, touched, orphans);
+		if (child->entry_num < m) {
+			orphans[child->level].insert(orphans[child->level].end(), child->entries, child->entries + child->entry_num);
+			node->remove_entry(i);
+			free_node(child);
+		}
+		else
+			node->set_entry_mbr(i, get_mbr(child->entries, child->entry_num));
+	}
+}
+
+
+//
+// Find the leaf holding the live record with record id ``rid'' and, unless ``key'' is NULL,
+// an MBR equal to ``key'', with the path to it. With the locator the leaf is known and
+// only the subtrees containing the record are searched for the path; otherwise, or if
+// the locator entry is stale, the tree is searched for the record.
+// Return: the leaf, or NULL; the index of the record in ``idx''.
+//
+template <int D>
+RTNode<D>* RTree<D>::locate_record(const BoundingBox<D>* key, int rid, RTNode<D>** stack, int* entry_idx, int& stack_size, int& idx)
+{
+	if (use_locator) {
+		typename unordered_map<int, RTNode<D>*>::iterator it = locator.find(rid);
+		if (it == locator.end())
+			return NULL;
+		RTNode<D>* leaf = it->second;
+		for (int i = 0; leaf->level == 0 && i < leaf->entry_num; i++) {
+			const Entry<D>& e = leaf->entries[i];
+			if (e.get_rid() == rid && !e.is_deleted() && (key == NULL || e.get_mbr().is_equal(*key))) {
+				if (!find_path(root, leaf, e.get_mbr(), stack, entry_idx, stack_size))
+					break;
+				idx = i;
+				return leaf;
+			}
+		}
+		stack_size = 0;
+	}
+	return find_record(root, stack, entry_idx, stack_size, key, rid, idx);
+}
+
+
+//
+// Insert ``records'' in the order of the Hilbert curve through their centers. Each record
+// descends from the lowest node on the path of the previous one that contains its key;
+// the MBRs on that path are brought up to date only when the path is left, so a node
+// is adjusted once per run of records going through it. A leaf is split when full,
+// by insert() itself. As with insert(), only the first record of each key is kept.
+// Return: the number of records inserted.
+//
+template <int D>
+int RTree<D>::insert_batch(const vector<Entry<D> >& records)
+{
+	flush();
+	vector<Entry<D> > entry_list(records);
+	hilbert_sort(entry_list);
+
+	int inserted = 0;
+	int path_size = 0; // the path of the last record, whose entry MBRs may be stale
+	for (size_t r = 0; r < entry_list.size(); r++) {
+		const Entry<D>& e = entry_list[r];
+		grow_scratch();
+		RTNode<D>** stack = &path_stack[0];
+		int* entry_idx = &path_idx[0];
+
+		// keep the levels whose entries contain the key, bring the others up to date.
+		int prefix = 0;
+		while (prefix < path_size && overlap(stack[prefix]->entries[entry_idx[prefix]].get_mbr(), e.get_mbr()))
+			prefix++;
+		adjust_tree(stack + prefix, entry_idx + prefix, path_size - prefix);
+
+		// the kept levels are not searched again by choose_leaf(): look for the key beside them.
+		bool duplicate = false;
+		RTNode<D>* dup_leaf;
+		int dup_idx;
+		for (int k = 0; k < prefix && !duplicate; k++) {
+			for (int base = 0; base < stack[k]->entry_num && !duplicate; base += 64) {
+				unsigned long long hits = stack[k]->intersect_mask(e.get_mbr(), base);
+				while (hits != 0 && !duplicate) {
+					int i = base + __builtin_ctzll(hits);
+					hits &= hits - 1;
+					if (i != entry_idx[k])
+						duplicate = find_entry(stack[k]->entries[i].get_ptr(), e.get_mbr(), dup_leaf, dup_idx);
+				}
+			}
+		}
+		path_size = prefix;
+		RTNode<D>* leaf = NULL;
+		if (!duplicate)
+			leaf = choose_leaf(stack, entry_idx, path_size, e, 0, true, dup_leaf, dup_idx);
+		if (leaf == NULL) {
+			if (dup_leaf->entries[dup_idx].is_deleted())
+				dup_leaf = own_leaf(dup_leaf, e.get_mbr());
+			if (revive(dup_leaf, dup_idx, e))
+				inserted++;
+			continue;
+		}
+		leaf = own_path(stack, entry_idx, path_size, leaf);
+
+		inserted++;
+		if (leaf->entry_num < max_entry_num) {
+			leaf->add_entry(e);
+			if (use_locator && !e.is_deleted())
+				locator[e.get_rid()] = leaf;
+			continue;
+		}
+		// a split may reshape the path: finish it, and start over from the root.
+		adjust_tree(stack, entry_idx, path_size);
+		reinserted.assign(root->level + 1, false);
+		insert(e, 0, false, buffer_size == 0, path_size);
+		path_size = 0;
+	}
+	adjust_tree(&path_stack[0], &path_idx[0], path_size);
+
+	return inserted;
+}
+
+
+//
+// Move the record ``rid'' from ``old_coord'' to ``new_coord''.
+//
+template <int D>
+bool RTree<D>::update(int rid, const vector<int>& old_coord, const vector<int>& new_coord)
+{
+	return update(rid, old_coord, new_coord, 0);
+}
+
+
+//
+// Move the record ``rid'' from ``old_coord'' to ``new_coord'' bottom-up. The record stays in
+// its leaf if the new key lies within the leaf MBR grown by ``tolerance'' on every side.
+// Otherwise it leaves the leaf and is inserted below the lowest node on its path whose MBR
+// contains the new key, unless the leaf underflows, in which case the tree is condensed
+// as for a deletion and the record inserted from the root.
+// Return: false if there is no such record or another record has key ``new_coord''.
+//
+template <int D>
+bool RTree<D>::update(int rid, const vector<int>& old_coord, const vector<int>& new_coord, int tolerance)
+{
+	flush();
+	if ((int)old_coord.size() != this->dimension || (int)new_coord.size() != this->dimension)
+	{
+		cerr << "R-tree dimensionality inconsistency\n";
+		return false;
+	}
+	BoundingBox<D> old_mbr(old_coord, old_coord);
+	BoundingBox<D> new_mbr(new_coord, new_coord);
+
+	grow_scratch();
+	RTNode<D>** stack = &path_stack[0];
+	int stack_size = 0;
+	int* entry_idx = &path_idx[0];
+	int idx;
+	RTNode<D>* leaf = locate_record(&old_mbr, rid, stack, entry_idx, stack_size, idx);
+	if (leaf == NULL)
+		return false;
+	if (new_mbr.is_equal(old_mbr))
+		return true;
+	leaf = own_path(stack, entry_idx, stack_size, leaf);
+
+	bool in_place = true;
+	if (stack_size > 0) {
+		const BoundingBox<D>& leaf_mbr = stack[stack_size-1]->entries[entry_idx[stack_size-1]].get_mbr();
+		for (int i = 0; i < dimension && in_place; i++) {
+			in_place = new_coord[i] >= leaf_mbr.get_lowestValue_at(i) - tolerance
+				&& new_coord[i] <= leaf_mbr.get_highestValue_at(i) + tolerance;
+		}
+	}
+	// the lowest node on the path containing the new key: another record with the key is
+	// below it or beside the path above it. A reinsertion looks below it on its way down.
+	int prefix = stack_size;
+	while (prefix > 0 && !overlap(stack[prefix-1]->entries[entry_idx[prefix-1]].get_mbr(), new_mbr))
+		prefix--;
+	RTNode<D>* dup_leaf;
+	int dup_idx;
+	if (find_beside_path(stack, entry_idx, prefix, new_mbr, dup_leaf, dup_idx)
+		|| (in_place && find_entry(prefix > 0 ? stack[prefix-1]->entries[entry_idx[prefix-1]].get_ptr() : root,
+			new_mbr, dup_leaf, dup_idx))) {
+		if (!dup_leaf->entries[dup_idx].is_deleted())
+			return false;
+		// a tombstone holds the new key: the record takes its place, leaving a tombstone behind.
+		dup_leaf = own_leaf(dup_leaf, new_mbr);
+		Entry<D> e = leaf->entries[idx];
+		bury(leaf, idx);
+		revive(dup_leaf, dup_idx, e);
+		check_compact();
+		return true;
+	}
+	if (in_place) {
+		leaf->set_entry_mbr(idx, new_mbr);
+		adjust_tree(stack, entry_idx, stack_size);
+		return true;
+	}
+
+	Entry<D> e = leaf->entries[idx];
+	e.set_mbr(new_mbr);
+	leaf->remove_entry(idx);
+	reinserted.assign(root->level + 1, false);
+	if (leaf->entry_num < max_entry_num/2 + 1) {
+		remove_record(leaf, stack, entry_idx, stack_size);
+		prefix = 0;
+	} else {
+		adjust_tree(stack, entry_idx, stack_size);
+		// keep the path down to the lowest node containing the new key.
+		while (prefix > 0 && !overlap(stack[prefix-1]->entries[entry_idx[prefix-1]].get_mbr(), new_mbr))
+			prefix--;
+	}
+	if (insert(e, 0, false, true, prefix))
+		return true;
+	// another record has the new key: put the record back.
+	e.set_mbr(old_mbr);
+	reinserted.assign(root->level + 1, false);
+	insert(e, 0, false, false, 0);
+	return false;
+}
+
+
+//
+// Helper function for update(): find a record intersecting ``mbr'' below the entries beside
+// the path in the first ``depth'' nodes of ``stack''.
+// Return: whether there is one, with its leaf in ``leaf'' and its index in ``idx''.
+//
+template <int D>
+bool RTree<D>::find_beside_path(RTNode<D>** stack, const int* entry_idx, int depth, const BoundingBox<D>& mbr,
+	RTNode<D>*& leaf, int& idx)
+{
+	for (int k = 0; k < depth; k++) {
+		RTNode<D>* node = stack[k];
+		for (int base = 0; base < node->entry_num; base += 64) {
+			unsigned long long hits = node->intersect_mask(mbr, base);
+			while (hits != 0) {
+				int i = base + __builtin_ctzll(hits);
+				hits &= hits - 1;
+				if (i != entry_idx[k] && find_entry(node->entries[i].get_ptr(), mbr, leaf, idx))
+					return true;
+			}
+		}
+	}
+	return false;
+}
+
+
+//
+// Switch buffered insertion on with buffers of ``size'' records per internal node,
+// or off with 0. insert() then leaves each record in the buffer of the root; a full
+// buffer is emptied into the children, the buffers of leaf parents into the leaves,
+// so each node handles its records in bulk. Queries look into the buffers they pass.
+// Buffered records are not checked for duplicate keys, and insert() always succeeds.
+// The other updates flush the buffers first; bulk_load() drops them.
+//
+template <int D>
+void RTree<D>::set_buffer_size(int size)
+{
+	if (size <= 0)
+		flush();
+	buffer_size = size > 0 && !snapshots ? size : 0;
+}
+
+
+//
+// Put the record ``e'' in the buffer of ``node''.
+//
+template <int D>
+void RTree<D>::push_buffer(RTNode<D>* node, const Entry<D>& e)
+{
+	if (node->buffer.empty())
+		node->buffer_mbr = e.get_mbr();
+	else
+		node->buffer_mbr.group_with(e.get_mbr());
+	node->buffer.push_back(e);
+	buffered_cnt++;
+}
+
+
+//
+// Empty the buffer of ``node'' into its children. A child buffer filling up is
+// emptied in turn. A full leaf is split through insert(); as that can reshape the
+// paths above, the records not handled yet go back to the buffer of the root.
+// Return: whether insert() was called.
+//
+template <int D>
+bool RTree<D>::flush_node(RTNode<D>* node)
+{
+	grow_scratch();
+	int level = node->level;
+	// indexed rather than held by reference: nested calls may grow flush_buffer.
+	flush_buffer[level].swap(node->buffer);
+	buffered_cnt -= flush_buffer[level].size();
+
+	bool reshaped = false;
+	size_t i = 0;
+	for (; i < flush_buffer[level].size() && !reshaped; i++) {
+		Entry<D> e = flush_buffer[level][i];
+		int idx = choose_subtree(node, e.get_mbr(), 0);
+		RTNode<D>* child = node->entries[idx].get_ptr();
+		BoundingBox<D> mbr = node->entries[idx].get_mbr();
+		mbr.group_with(e.get_mbr());
+		if (child->level > 0) {
+			node->set_entry_mbr(idx, mbr);
+			push_buffer(child, e);
+			if ((int)child->buffer.size() >= buffer_size)
+				reshaped = flush_node(child);
+		}
+		else if (child->entry_num < max_entry_num) {
+			node->set_entry_mbr(idx, mbr);
+			child->add_entry(e);
+			if (use_locator)
+				locator[e.get_rid()] = child;
+		}
+		else {
+			reinserted.assign(root->level + 1, false);
+			insert(e, 0);
+			reshaped = true;
+		}
+	}
+	for (; i < flush_buffer[level].size(); i++)
+		push_buffer(root, flush_buffer[level][i]);
+	flush_buffer[level].clear();
+	return reshaped;
+}
+
+
+//
+// Move the buffered records of ``node'', just split, to whichever of ``node'' and
+// ``new_node'' they enlarge less, and grow ``old_mbr'' and ``new_mbr'' over them.
+//
+template <int D>
+void RTree<D>::share_buffer(RTNode<D>* node, RTNode<D>* new_node, BoundingBox<D>& old_mbr, BoundingBox<D>& new_mbr)
+{
+	vector<Entry<D> > records;
+	records.swap(node->buffer);
+	buffered_cnt -= records.size();
+	for (size_t i = 0; i < records.size(); i++) {
+		if (area_inc(old_mbr, records[i].get_mbr()) <= area_inc(new_mbr, records[i].get_mbr())) {
+			push_buffer(node, records[i]);
+			update_mbr(old_mbr, records[i].get_mbr());
+		}
+		else {
+			push_buffer(new_node, records[i]);
+			update_mbr(new_mbr, records[i].get_mbr());
+		}
+	}
+}
+
+
+//
+// Move the records buffered in the subtree of ``node'' to ``records''.
+//
+template <int D>
+void RTree<D>::collect_buffers(RTNode<D>* node, vector<Entry<D> >& records)
+{
+	if (node->level == 0)
+		return;
+	records.insert(records.end(), node->buffer.begin(), node->buffer.end());
+	node->buffer.clear();
+	for (int i = 0; i < node->entry_num; i++)
+		collect_buffers(node->entries[i].get_ptr(), records);
+}
+
+
+//
+// Insert every buffered record into the leaves, in Hilbert order.
+//
+template <int D>
+void RTree<D>::flush()
+{
+	if (buffered_cnt == 0)
+		return;
+	vector<Entry<D> > records;
+	collect_buffers(root, records);
+	buffered_cnt = 0;
+	hilbert_sort(records);
+	for (size_t i = 0; i < records.size(); i++) {
+		reinserted.assign(root->level + 1, false);
+		insert(records[i], 0);
+	}
+}
+
+
+//
+// Delete records lazily if ``enabled'': del() marks the record as a tombstone in its leaf,
+// which queries pass over, and the tree is not restructured. compact() removes the
+// tombstones; it runs by itself once they make up more than ``ratio'' of the leaf entries,
+// unless ``ratio'' is 0. An insertion with the key of a tombstone takes its place.
+//
+template <int D>
+void RTree<D>::set_lazy_delete(bool enabled, double ratio)
+{
+	lazy_delete = enabled;
+	compact_ratio = ratio > 0 ? ratio : 0;
+	compact_check = 0;
+}
+
+
+//
+// Turn the record at ``idx'' of ``leaf'' into a tombstone.
+//
+template <int D>
+void RTree<D>::bury(RTNode<D>* leaf, int idx)
+{
+	Entry<D>& e = leaf->entries[idx];
+	if (use_locator) {
+		typename unordered_map<int, RTNode<D>*>::iterator it = locator.find(e.get_rid());
+		if (it != locator.end() && it->second == leaf)
+			locator.erase(it);
+	}
+	e.set_deleted(true);
+	tombstone_cnt++;
+}
+
+
+//
+// Compact the tree if tombstones are over the ratio given to set_lazy_delete().
+//
+template <int D>
+void RTree<D>::check_compact()
+{
+	// the leaf entries are counted only when the last count may be out of date.
+	if (compact_ratio > 0 && tombstone_cnt > compact_ratio * compact_check) {
+		long long entry_cnt = 0;
+		count_records(root, entry_cnt);
+		if (tombstone_cnt > compact_ratio * entry_cnt)
+			compact();
+		else
+			compact_check = entry_cnt;
+	}
+}
+
+
+//
+// Give the tombstone at ``idx'' of ``leaf'' the record id of ``e'' and make it a live
+// record again. Nothing is done if ``e'' is a tombstone itself.
+// Return: false if the entry at ``idx'' is not a tombstone.
+//
+template <int D>
+bool RTree<D>::revive(RTNode<D>* leaf, int idx, const Entry<D>& e)
+{
+	Entry<D>& dead = leaf->entries[idx];
+	if (!dead.is_deleted() || e.is_deleted())
+		return false;
+	dead.set_rid(e.get_rid());
+	dead.set_deleted(false);
+	tombstone_cnt--;
+	if (use_locator)
+		locator[e.get_rid()] = leaf;
+	return true;
+}
+
+
+//
+// Count the leaf entries, tombstones included, below ``node'' into ``entry_cnt''.
+//
+template <int D>
+void RTree<D>::count_records(RTNode<D>* node, long long& entry_cnt)
+{
+	if (node->level == 0) {
+		entry_cnt += node->entry_num;
+		return;
+	}
+	for (int i = 0; i < node->entry_num; i++)
+		count_records(node->entries[i].get_ptr(), entry_cnt);
+}
+
+
+//
+// Take the tombstones out of the leaves below ``node'', and add every node that lost
+// entries, or has such a node below it, to ``touched''.
+// Return: the number of tombstones removed.
+//
+template <int D>
+int RTree<D>::purge(RTNode<D>* node, unordered_set<RTNode<D>*>& touched)
+{
+	int purged = 0;
+	if (node->level == 0) {
+		// backwards, as remove_entry() moves the last entry into the hole.
+		for (int i = node->entry_num - 1; i >= 0; i--) {
+			if (node->entries[i].is_deleted()) {
+				node->remove_entry(i);
+				purged++;
+			}
+		}
+	}
+	else {
+		for (int i = 0; i < node->entry_num; i++) {
+			// snapshot mode: copy only the paths to tombstones.
+			if (snapshots && !has_tombstone(node->entries[i].get_ptr()))
+				continue;
+			purged += purge(own_child(node, i), touched);
+		}
+	}
+	if (purged > 0)
+		touched.insert(node);
+	return purged;
+}
+
+
+//
+// Remove every tombstone, and rebuild the nodes left underfull as delete_batch() does.
+// Return: the number of tombstones removed.
+//
+template <int D>
+int RTree<D>::compact()
+{
+	flush();
+	compact_check = 0;
+	if (tombstone_cnt == 0)
+		return 0;
+	unordered_set<RTNode<D>*> touched;
+	int purged = purge(own_root(), touched);
+	tombstone_cnt = 0;
+	condense_touched(touched);
+	return purged;
+}
+
+
+//
+// Keep a map from record ids to the leaves holding them, which del_rid() uses
+// to skip the search. Record ids are expected to be distinct while it is on.
+//
+template <int D>
+void RTree<D>::set_locator(bool enabled)
+{
+	use_locator = enabled;
+	locator.clear();
+	if (enabled)
+		locate_all(root);
+}
+
+
+
+//
+// Switch snapshot mode on or off. In snapshot mode the queries read the tree as it was
+// at the last publish(), while the updates work on copies of the nodes they modify:
+// each path from the root to a node an update changes is copied once per publish(),
+// so the queries of any number of threads run alongside one updating thread without
+// locks. The writer calls publish() to let the queries see its updates, after each one
+// or after a batch of them; the nodes left out of the tree are freed once no query
+// can still be reading them. Buffered insertion is off in this mode.
+// The mode is switched while no query runs.
+//
+template <int D>
+void RTree<D>::set_snapshots(bool enabled)
+{
+	if (enabled) {
+		set_buffer_size(0);
+		snapshots = true;
+		publish();
+		return;
+	}
+	snapshots = false;
+	published.store(root);
+	for (int i = 0; i < 3; i++) {
+		for (size_t j = 0; j < limbo[i].size(); j++)
+			node_pool->release(limbo[i][j]);
+		limbo[i].clear();
+	}
+	for (size_t j = 0; j < replaced.size(); j++)
+		node_pool->release(replaced[j]);
+	replaced.clear();
+}
+
+
+//
+// Snapshot mode: make the tree as updated so far the one the queries read, and free
+// the nodes no query can reach any more.
+//
+template <int D>
+void RTree<D>::publish()
+{
+	if (!snapshots)
+		return;
+	published.store(root);
+	// the nodes in the tree now belong to the snapshot: updates copy them from here on.
+	node_pool->next_version();
+	vector<RTNode<D>*>& retired = limbo[epochs.get_epoch() % 3];
+	retired.insert(retired.end(), replaced.begin(), replaced.end());
+	replaced.clear();
+	if (epochs.try_advance()) {
+		// what is left in the slot of the new epoch was retired three epochs ago.
+		vector<RTNode<D>*>& reclaimed = limbo[epochs.get_epoch() % 3];
+		for (size_t i = 0; i < reclaimed.size(); i++)
+			node_pool->release(reclaimed[i]);
+		reclaimed.clear();
+	}
+}
+
+
+//
+// Whether an update may modify ``node'' in place: always, unless in snapshot mode,
+// where only the nodes created since the last publish() may be.
+//
+template <int D>
+bool RTree<D>::is_private(const RTNode<D>* node) const
+{
+	return !snapshots || node->version == node_pool->get_version();
+}
+
+
+//
+// Snapshot mode: a private copy of ``node'', which the caller puts in its place.
+//
+template <int D>
+RTNode<D>* RTree<D>::copy_node(RTNode<D>* node)
+{
+	RTNode<D>* copy = node_pool->alloc(node->level);
+	*copy = *node;
+	locate(copy);
+	replaced.push_back(node);
+	return copy;
+}
+
+
+//
+// The root, copied first if it is not private.
+//
+template <int D>
+RTNode<D>* RTree<D>::own_root()
+{
+	if (!is_private(root))
+		root = copy_node(root);
+	return root;
+}
+
+
+//
+// The child at ``idx'' of the private node ``parent'', copied first if it is not private.
+//
+template <int D>
+RTNode<D>* RTree<D>::own_child(RTNode<D>* parent, int idx)
+{
+	RTNode<D>* child = parent->entries[idx].get_ptr();
+	if (!is_private(child)) {
+		child = copy_node(child);
+		parent->entries[idx].set_ptr(child);
+	}
+	return child;
+}
+
+
+//
+// Make the nodes on the path in ``stack'' and ``entry_idx'', which starts at the root,
+// private, top-down, and ``node'', which the path leads to. ``stack'' is updated with the copies.
+// Return: the private ``node''.
+//
+template <int D>
+RTNode<D>* RTree<D>::own_path(RTNode<D>** stack, int* entry_idx, int stack_size, RTNode<D>* node)
+{
+	if (is_private(node))
+		return node;
+	if (stack_size == 0)
+		return own_root();
+	stack[0] = own_root();
+	for (int k = 1; k < stack_size; k++)
+		stack[k] = own_child(stack[k-1], entry_idx[k-1]);
+	return own_child(stack[stack_size-1], entry_idx[stack_size-1]);
+}
+
+
+//
+// As own_path(), for ``leaf'' holding a record with MBR ``mbr'', whose path is not known.
+//
+template <int D>
+RTNode<D>* RTree<D>::own_leaf(RTNode<D>* leaf, const BoundingBox<D>& mbr)
+{
+	if (is_private(leaf))
+		return leaf;
+	grow_scratch();
+	int stack_size = 0;
+	find_path(root, leaf, mbr, &copy_stack[0], &copy_idx[0], stack_size);
+	return own_path(&copy_stack[0], &copy_idx[0], stack_size, leaf);
+}
+
+
+//
+// Give ``node'', taken out of the tree, back to the pool, or in snapshot mode, if
+// the queries may still be reading it, keep it until they are done.
+//
+template <int D>
+void RTree<D>::free_node(RTNode<D>* node)
+{
+	if (is_private(node))
+		node_pool->release(node);
+	else
+		replaced.push_back(node);
+}
+
+
+//
+// free_node() the subtree of ``node''.
+//
+template <int D>
+void RTree<D>::free_tree(RTNode<D>* node)
+{
+	if (node->level != 0) {
+		for (int i = 0; i < node->entry_num; i++)
+			free_tree(node->entries[i].get_ptr());
+	}
+	free_node(node);
+}
+
+
+//
+// Whether there is a tombstone below ``node''.
+//
+template <int D>
+bool RTree<D>::has_tombstone(const RTNode<D>* node) const
+{
+	for (int i = 0; i < node->entry_num; i++) {
+		if (node->level == 0 ? node->entries[i].is_deleted() : has_tombstone(node->entries[i].get_ptr()))
+			return true;
+	}
+	return false;
+}
+
+
+//
+// Snapshot mode: keep the nodes a query reads from being freed until unpin().
+// Return: the slot to pass to unpin().
+//
+template <int D>
+int RTree<D>::pin() const
+{
+	return snapshots ? epochs.enter() : -1;
+}
+
+
+template <int D>
+void RTree<D>::unpin(int slot) const
+{
+	if (slot >= 0)
+		epochs.leave(slot);
+}
+
+
+//
+// The root the queries start from: the published one in snapshot mode.
+//
+template <int D>
+const RTNode<D>* RTree<D>::snapshot_root() const
+{
+	return snapshots ? published.load() : root;
+}
+
+
+
+//
+// Insert a record with key ``coordinate'' and record id ``rid'' while other threads do the
+// same (R-link tree, Kornacker and Banks). Only the nodes on the path are latched, one at
+// a time on the way down: an internal node is latched shared, unless the entry chosen in it
+// must grow to cover the key, and the leaf exclusively. Entry MBRs only grow in this mode,
+// so a node reached through a stale pointer can still take the record. A split moves part
+// of a node to a new right sibling, which is linked to it, before the parent is updated:
+// see split_latched(). As with buffered insertion, duplicate keys are not checked for,
+// and R* forced reinsertion is not done: a full node is always split.
+// The locator, buffered insertion, lazy deletion and snapshots must be off.
+// Return: true.
+//
+template <int D>
+bool RTree<D>::insert_latched(const vector<int>& coordinate, int rid)
+{
+	if ((int)coordinate.size() != this->dimension)
+	{
+		cerr << "R-tree dimensionality inconsistency\n";
+		return false;
+	}
+	BoundingBox<D> mbr(coordinate, coordinate);
+	Entry<D> e(mbr, rid);
+
+	vector<RTNode<D>*> path;	// the nodes passed, from the top
+	RTNode<D>* node = latch_root();
+	while (node->level > 0) {
+		int idx = choose_subtree(node, mbr, 0);
+		BoundingBox<D> grown = node->entries[idx].get_mbr();
+		grown.group_with(mbr);
+		if (!grown.is_equal(node->entries[idx].get_mbr())) {
+			// the entry must grow: take the node for this thread alone.
+			node->latch.unlock_shared();
+			node->latch.lock();
+			if (path.empty()) {
+				// nothing above covers the new key: the node must still be the root.
+				lock_guard<mutex> guard(root_lock);
+				if (node != root) {
+					node->latch.unlock();
+					node = NULL;
+				}
+			}
+			if (node == NULL) {
+				node = latch_root();
+				continue;
+			}
+			idx = choose_subtree(node, mbr, 0);
+			grown = node->entries[idx].get_mbr();
+			grown.group_with(mbr);
+			node->set_entry_mbr(idx, grown);
+			path.push_back(node);
+			node = node->entries[idx].get_ptr();
+			path.back()->latch.unlock();
+		}
+		else {
+			path.push_back(node);
+			node = node->entries[idx].get_ptr();
+			path.back()->latch.unlock_shared();
+		}
+		if (node->level == 0)
+			node->latch.lock();
+		else
+			node->latch.lock_shared();
+	}
+
+	if (node->entry_num < max_entry_num) {
+		node->add_entry(e);
+		node->latch.unlock();
+	}
+	else
+		split_latched(node, e, path);
+	return true;
+}
+
+
+//
+// Latch the root: exclusively if it is a leaf, shared otherwise.
+//
+template <int D>
+RTNode<D>* RTree<D>::latch_root() const
+{
+	while (true) {
+		root_lock.lock();
+		RTNode<D>* node = root;
+		root_lock.unlock();
+		if (node->level == 0)
+			node->latch.lock();
+		else
+			node->latch.lock_shared();
+		// a root split needs the old root latched: once latched, the root stays.
+		root_lock.lock();
+		bool is_root = node == root;
+		root_lock.unlock();
+		if (is_root)
+			return node;
+		if (node->level == 0)
+			node->latch.unlock();
+		else
+			node->latch.unlock_shared();
+	}
+}
+
+
+//
+// Split the latched full node ``node'' with the entry ``e'', and post the new node to the
+// parent, splitting the parent in turn if it is full. ``path'' holds the nodes passed on the
+// way down to ``node''. Each split node keeps its latch until the split is posted, and the
+// latches are taken bottom-up, or left to right on one level, so that latched insertions
+// do not deadlock. The sequence number a split node gets is taken once the new entry is in
+// the parent: a query that read the parent before then follows the right-link.
+//
+template <int D>
+void RTree<D>::split_latched(RTNode<D>* node, const Entry<D>& e, const vector<RTNode<D>*>& path)
+{
+	// split_buffer belongs to the tree, while latched splits run on several threads.
+	static thread_local vector<Entry<D> > entry_buffer;
+	if ((int)entry_buffer.size() < max_entry_num + 1)
+		entry_buffer.resize(max_entry_num + 1);
+	vector<RTNode<D>*> latched;
+	Entry<D> new_entry = e;
+	while (true) {
+		for (int i = 0; i < node->entry_num; i++) {
+			entry_buffer[i] = node->entries[i];
+		}
+		entry_buffer[max_entry_num] = new_entry;
+		RTNode<D>* new_node = node_pool->alloc(node->level);
+		BoundingBox<D> old_mbr, new_mbr;
+		split_node(&entry_buffer[0], node, new_node, old_mbr, new_mbr);
+		new_node->right = node->right;
+		new_node->nsn = node->nsn;
+		node->right = new_node;
+		latched.push_back(node);
+
+		RTNode<D>* parent = latch_parent(node, path);
+		if (parent == NULL) {
+			// ``node'' is the root, and root_lock is held.
+			RTNode<D>* new_root = node_pool->alloc(node->level+1);
+			new_root->set_entry_mbr(0, old_mbr);
+			new_root->entries[0].set_ptr(node);
+			new_root->set_entry_mbr(1, new_mbr);
+			new_root->entries[1].set_ptr(new_node);
+			new_root->entry_num = 2;
+			node->nsn = ++split_cnt;
+			if ((int)level_head.size() <= new_root->level)
+				level_head.resize(new_root->level + 1);
+			level_head[new_root->level] = new_root;
+			root = new_root;
+			root_lock.unlock();
+			break;
+		}
+		// the entry of ``node'' is left as it is: a thread on its way down may
+		// have grown it for a record it is about to add to ``node''.
+		new_entry.set_mbr(new_mbr);
+		new_entry.set_ptr(new_node);
+		if (parent->entry_num < max_entry_num) {
+			parent->add_entry(new_entry);
+			node->nsn = ++split_cnt;
+			latched.push_back(parent);
+			break;
+		}
+		// the new entry is in ``parent'' or its new sibling once it is split.
+		node->nsn = ++split_cnt;
+		node = parent;
+	}
+	for (size_t i = 0; i < latched.size(); i++)
+		latched[i]->latch.unlock();
+}
+
+
+//
+// Latch the node holding the entry of ``node'' exclusively: the node above ``node'' in
+// ``path'', or a node split off it since, found through the right-links. If ``node''
+// was the top of the path, the parent is on the level grown by the root split since.
+// Return: the parent, or NULL if ``node'' is the root, with root_lock held.
+//
+template <int D>
+RTNode<D>* RTree<D>::latch_parent(RTNode<D>* node, const vector<RTNode<D>*>& path)
+{
+	RTNode<D>* parent;
+	int top = path.empty() ? node->level : path[0]->level;
+	if (top > node->level)
+		parent = path[top - node->level - 1];
+	else {
+		root_lock.lock();
+		if (node == root)
+			return NULL;
+		parent = level_head[node->level + 1];
+		root_lock.unlock();
+	}
+	parent->latch.lock();
+	while (true) {
+		for (int i = 0; i < parent->entry_num; i++) {
+			if (parent->entries[i].get_ptr() == node)
+				return parent;
+		}
+		// the entry of ``node'' only moves right, so the level cannot end before it.
+		RTNode<D>* next = parent->right;
+		assert(next != NULL);
+		next->latch.lock();
+		parent->latch.unlock();
+		parent = next;
+	}
+}
+
+
+//
+// query_range() alongside insert_latched(). Each node is latched shared while it is read,
+// with the split counter at that time: a child split since has a greater sequence number,
+// and the nodes split off it are reached through its right-link.
+//
+template <int D>
+void RTree<D>::query_range_latched(const BoundingBox<D>& mbr, int& result_count, int& node_travelled) const
+{
+	result_count = 0;
+	node_travelled = 0;
+	vector<pair<const RTNode<D>*, unsigned long long> > pending;
+	root_lock.lock();
+	pending.push_back(make_pair((const RTNode<D>*)root, split_cnt.load()));
+	root_lock.unlock();
+	while (!pending.empty()) {
+		const RTNode<D>* node = pending.back().first;
+		unsigned long long memo = pending.back().second;
+		pending.pop_back();
+		node->latch.lock_shared();
+		node_travelled++;
+		if (node->nsn > memo)
+			pending.push_back(make_pair((const RTNode<D>*)node->right, memo));
+		unsigned long long cnt = split_cnt.load();
+		for (int base = 0; base < node->entry_num; base += 64) {
+			unsigned long long hits = node->intersect_mask(mbr, base);
+			if (node->level == 0) {
+				result_count += __builtin_popcountll(hits);
+				continue;
+			}
+			while (hits != 0) {
+				int i = base + __builtin_ctzll(hits);
+				hits &= hits - 1;
+				pending.push_back(make_pair((const RTNode<D>*)node->entries[i].get_ptr(), cnt));
+			}
+		}
+		node->latch.unlock_shared();
+	}
+}
+
+
+
+template <int D>
+void RTree<D>::query_range(const BoundingBox<D>& mbr, int& result_count, int& node_travelled) const
+{
+	
+	result_count = 0;
+	node_travelled = 0;
+	int slot = pin();
+	query_range(snapshot_root(), mbr, result_count, node_travelled);
+	unpin(slot);
+}
+
+
+//
+// Append the records inside ``mbr'' to ``results''. The buffer is not cleared,
+// so a caller can reuse it across queries without reallocating.
+//
+template <int D>
+void RTree<D>::query_range(const BoundingBox<D>& mbr, vector<Entry<D> >& results, int& node_travelled) const
+{
+	EntryCollector<D> collector(results);
+	node_travelled = 0;
+	int slot = pin();
+	query_range(snapshot_root(), mbr, collector, node_travelled);
+	unpin(slot);
+}
+
+
+//
+// Pass the records inside ``mbr'' to ``visitor'' until it returns false.
+// Return true if the whole range was visited.
+//
+template <int D>
+bool RTree<D>::query_range(const BoundingBox<D>& mbr, EntryVisitor<D>& visitor, int& node_travelled) const
+{
+	node_travelled = 0;
+	int slot = pin();
+	bool done = query_range(snapshot_root(), mbr, visitor, node_travelled);
+	unpin(slot);
+	return done;
+}
+
+
+//
+// Parallel form of query_range(): the nodes inside ``mbr'' are expanded level by level until
+// there are enough of them to keep ``pool'' busy. If the records below them are estimated to
+// be few, the query goes on serially. Otherwise each subtree becomes a task, which splits
+// into a task per child down to the parents of the leaves so that idle workers can steal them.
+// The records go to ``results'' unless it is NULL.
+//
+template <int D>
+void RTree<D>::query_range(const BoundingBox<D>& mbr, vector<Entry<D> >* results, int& result_count, int& node_travelled, ThreadPool& pool) const
+{
+	result_count = 0;
+	node_travelled = 0;
+	int slot = pin();
+	vector<const RTNode<D>*> frontier(1, snapshot_root());
+	vector<const RTNode<D>*> next;
+	int width = 4 * pool.get_thread_num();
+	while (!frontier.empty() && frontier[0]->level > 0 && (int)frontier.size() < width) {
+		next.clear();
+		for (size_t n = 0; n < frontier.size(); n++) {
+			const RTNode<D>* node = frontier[n];
+			node_travelled++;
+			for (size_t i = 0; i < node->buffer.size(); i++) {
+				if (!node->buffer[i].get_mbr().is_intersected(mbr))
+					continue;
+				result_count++;
+				if (results != NULL)
+					results->push_back(node->buffer[i]);
+			}
+			for (int base = 0; base < node->entry_num; base += 64) {
+				for (unsigned long long hits = node->intersect_mask(mbr, base); hits != 0; hits &= hits - 1)
+					next.push_back(node->entries[base + __builtin_ctzll(hits)].get_ptr());
+			}
+		}
+		frontier.swap(next);
+	}
+
+	// records below the frontier, with nodes 70% full
+	long long estimate = frontier.size();
+	for (int l = 0; !frontier.empty() && l <= frontier[0]->level && estimate < PARALLEL_QUERY_RECORDS; l++)
+		estimate *= max(2, max_entry_num * 7 / 10);
+
+	if (pool.get_thread_num() <= 1 || estimate < PARALLEL_QUERY_RECORDS) {
+		for (size_t n = 0; n < frontier.size(); n++) {
+			if (results == NULL) {
+				query_range(frontier[n], mbr, result_count, node_travelled);
+				continue;
+			}
+			size_t found = results->size();
+			EntryCollector<D> collector(*results);
+			query_range(frontier[n], mbr, collector, node_travelled);
+			result_count += results->size() - found;
+		}
+	} else {
+		// slot 0 is for the calling thread
+		vector<QueryShard> shards(pool.get_thread_num() + 1);
+		for (size_t i = 0; i < shards.size(); i++) {
+			shards[i].result_cnt = 0;
+			shards[i].node_travelled = 0;
+		}
+		for (size_t n = 0; n < frontier.size(); n++) {
+			const RTNode<D>* node = frontier[n];
+			pool.submit([&, node]() { query_subtree(node, mbr, results != NULL, pool, shards); });
+		}
+		pool.wait();
+		for (size_t i = 0; i < shards.size(); i++) {
+			node_travelled += shards[i].node_travelled;
+			result_count += shards[i].result_cnt + shards[i].results.size();
+			if (results != NULL)
+				results->insert(results->end(), shards[i].results.begin(), shards[i].results.end());
+		}
+	}
+	unpin(slot);
+}
+
+
+//
+// Task of the parallel query_range(): search the subtree of ``node'' into the shard of the
+// running thread, handing every child but the first back to ``pool''.
+//
+template <int D>
+void RTree<D>::query_subtree(const RTNode<D>* node, const BoundingBox<D>& mbr, bool collect, ThreadPool& pool, vector<QueryShard>& shards) const
+{
+	QueryShard& shard = shards[pool.get_worker_index() + 1];
+	while (node->level > 1) {
+		shard.node_travelled++;
+		for (size_t i = 0; i < node->buffer.size(); i++) {
+			if (!node->buffer[i].get_mbr().is_intersected(mbr))
+				continue;
+			if (collect)
+				shard.results.push_back(node->buffer[i]);
+			else
+				shard.result_cnt++;
+		}
+		const RTNode<D>* first = NULL;
+		for (int base = 0; base < node->entry_num; base += 64) {
+			for (unsigned long long hits = node->intersect_mask(mbr, base); hits != 0; hits &= hits - 1) {
+				const RTNode<D>* child = node->entries[base + __builtin_ctzll(hits)].get_ptr();
+				if (first == NULL)
+					first = child;
+				else
+					pool.submit([&, child, collect]() { query_subtree(child, mbr, collect, pool, shards); });
+			}
+		}
+		if (first == NULL)
+			return;
+		node = first;
+	}
+	if (collect) {
+		EntryCollector<D> collector(shard.results);
+		query_range(node, mbr, collector, shard.node_travelled);
+	} else {
+		query_range(node, mbr, shard.result_cnt, shard.node_travelled);
+	}
+}
+
+
+template <int D>
+void RTree<D>::query_range(const BoundingBox<D>& mbr, int& result_count, int& node_travelled, ThreadPool& pool) const
+{
+	query_range(mbr, NULL, result_count, node_travelled, pool);
+}
+
+
+//
+// Append the records inside ``mbr'' to ``results'', in no particular order.
+//
+template <int D>
+void RTree<D>::query_range(const BoundingBox<D>& mbr, vector<Entry<D> >& results, int& node_travelled, ThreadPool& pool) const
+{
+	int result_count;
+	query_range(mbr, &results, result_count, node_travelled, pool);
+}
+
+
+template <int D>
+void RTree<D>::query_range_batch(const vector<BoundingBox<D> >& boxes, vector<vector<Entry<D> > >& results, int& node_travelled) const
+{
+	ThreadPool serial(1);
+	query_range_batch(boxes, results, node_travelled, serial);
+}
+
+
+//
+// Batch form of query_range(). A large batch is cut into runs of queries close along a Hilbert
+// curve, so that the queries of a run share most of their paths, and the runs are searched
+// by the threads of ``pool''.
+//
+template <int D>
+void RTree<D>::query_range_batch(const vector<BoundingBox<D> >& boxes, vector<vector<Entry<D> > >& results, int& node_travelled, ThreadPool& pool) const
+{
+	int len = boxes.size();
+	results.resize(len);
+	for (int i = 0; i < len; i++)
+		results[i].clear();
+	node_travelled = 0;
+	if (len == 0)
+		return;
+
+	int slot = pin();
+	const RTNode<D>* top = snapshot_root();
+	vector<int> order(len);
+	for (int i = 0; i < len; i++)
+		order[i] = i;
+	if (pool.get_thread_num() <= 1 || len < PARALLEL_BATCH_QUERIES) {
+		vector<vector<unsigned long long> > masks(top->level + 1);
+		vector<vector<int> > lists(top->level + 1);
+		query_batch(top, &boxes[0], &order[0], len, results, node_travelled, masks, lists);
+		unpin(slot);
+		return;
+	}
+
+	vector<int> centers(len * dimension);
+	for (int i = 0; i < len; i++) {
+		for (int d = 0; d < dimension; d++)
+			centers[i * dimension + d] = ((long long)boxes[i].get_lowestValue_at(d) + boxes[i].get_highestValue_at(d)) / 2;
+	}
+	vector<int> lowest(centers.begin(), centers.begin() + dimension);
+	vector<int> highest(lowest);
+	for (int i = 1; i < len; i++) {
+		for (int d = 0; d < dimension; d++) {
+			lowest[d] = min(lowest[d], centers[i * dimension + d]);
+			highest[d] = max(highest[d], centers[i * dimension + d]);
+		}
+	}
+	vector<pair<unsigned long long, int> > keys(len);
+	for (int i = 0; i < len; i++)
+		keys[i] = make_pair(hilbert_key(&centers[i * dimension], &lowest[0], &highest[0], dimension), i);
+	sort(keys.begin(), keys.end());
+	for (int i = 0; i < len; i++)
+		order[i] = keys[i].second;
+
+	int run_cnt = 4 * pool.get_thread_num();
+	vector<int> run_travelled(run_cnt, 0);
+	for (int r = 0; r < run_cnt; r++) {
+		int from = (long long)len * r / run_cnt, to = (long long)len * (r + 1) / run_cnt;
+		if (from == to)
+			continue;
+		pool.submit([&, from, to, r]() {
+			vector<vector<unsigned long long> > masks(top->level + 1);
+			vector<vector<int> > lists(top->level + 1);
+			int travelled = 0;
+			query_batch(top, &boxes[0], &order[from], to - from, results, travelled, masks, lists);
+			run_travelled[r] = travelled;
+		});
+	}
+	pool.wait();
+	for (int r = 0; r < run_cnt; r++)
+		node_travelled += run_travelled[r];
+	unpin(slot);
+}
+
+
+//
+// Pass each pair of intersecting records, the first from this tree and the second from ``other'',
+// to ``visitor'' until it returns false, by a synchronized traversal of both trees.
+// Return true if every pair was visited.
+//
+template <int D>
+bool RTree<D>::join(const RTree<D>& other, EntryPairVisitor<D>& visitor, int& node_travelled) const
+{
+	ThreadPool serial(1);
+	return join(other, visitor, node_travelled, serial);
+}
+
+
+//
+// join() on the threads of ``pool'': the node pairs are expanded level by level until there
+// are enough of them to keep the pool busy, and each is joined by a task. ``visitor'' is
+// then called from several threads at once.
+//
+template <int D>
+bool RTree<D>::join(const RTree<D>& other, EntryPairVisitor<D>& visitor, int& node_travelled, ThreadPool& pool) const
+{
+	node_travelled = 0;
+	if (other.dimension != dimension) {
+		cerr << "R-tree dimensionality inconsistency\n";
+		return false;
+	}
+	int slot1 = pin();
+	int slot2 = other.pin();
+	const RTNode<D>* root1 = snapshot_root();
+	const RTNode<D>* root2 = other.snapshot_root();
+	atomic<bool> stopped(false);
+	int sweep_cnt = 2 * (root1->level + root2->level + 1);
+	JoinState state;
+	state.visitor = &visitor;
+	state.sweep.resize(sweep_cnt);
+	state.node_travelled = 0;
+	state.deferred = NULL;
+	state.stopped = &stopped;
+	state.eps = 0;
+
+	bool done = join_buffers(root1, other, root2, state);
+	if (done && pool.get_thread_num() <= 1) {
+		done = join(root1, NULL, root2, NULL, state);
+	} else if (done) {
+		vector<JoinPair> pairs(1, JoinPair{root1, NULL, root2, NULL});
+		vector<JoinPair> next;
+		state.deferred = &next;
+		while (done && !pairs.empty() && (int)pairs.size() < 4 * pool.get_thread_num()
+			&& (pairs[0].node1->level > 0 || pairs[0].node2->level > 0)) {
+			next.clear();
+			for (size_t n = 0; n < pairs.size() && done; n++)
+				done = join(pairs[n].node1, pairs[n].mbr1, pairs[n].node2, pairs[n].mbr2, state);
+			pairs.swap(next);
+		}
+		vector<int> travelled(pairs.size(), 0);
+		for (size_t n = 0; n < pairs.size() && done; n++) {
+			pool.submit([&, n]() {
+				JoinState task;
+				task.visitor = &visitor;
+				task.sweep.resize(sweep_cnt);
+				task.node_travelled = 0;
+				task.deferred = NULL;
+				task.stopped = &stopped;
+				task.eps = 0;
+				join(pairs[n].node1, pairs[n].mbr1, pairs[n].node2, pairs[n].mbr2, task);
+				travelled[n] = task.node_travelled;
+			});
+		}
+		pool.wait();
+		for (size_t n = 0; n < pairs.size(); n++)
+			node_travelled += travelled[n];
+		done = !stopped.load();
+	}
+	node_travelled += state.node_travelled;
+	other.unpin(slot2);
+	unpin(slot1);
+	return done;
+}
+
+
+//
+// Pass each pair of records within distance ``eps'' of each other to ``visitor'' until it
+// returns false, the nearest points of their MBRs giving the distance. A pair comes once,
+// in no particular order. Return true if every pair was visited.
+//
+template <int D>
+bool RTree<D>::self_join(int eps, EntryPairVisitor<D>& visitor, int& node_travelled) const
+{
+	node_travelled = 0;
+	if (eps < 0) {
+		cerr << "Negative join distance\n";
+		return false;
+	}
+	int slot = pin();
+	const RTNode<D>* top = snapshot_root();
+	atomic<bool> stopped(false);
+	JoinState state;
+	state.visitor = &visitor;
+	state.sweep.resize(2 * (2 * top->level + 1));
+	state.node_travelled = 0;
+	state.deferred = NULL;
+	state.stopped = &stopped;
+	state.eps = eps;
+
+	// the records still in node buffers pair with the leaf records, then with each other.
+	bool done = true;
+	vector<Entry<D> > buffered;
+	if (buffered_cnt > 0)
+		gather_buffers(top, buffered);
+	for (size_t i = 0; i < buffered.size() && done; i++)
+		done = join_entry(buffered[i], expand(buffered[i].get_mbr(), eps), top, true, state);
+	for (size_t i = 0; i < buffered.size() && done; i++) {
+		for (size_t j = i + 1; j < buffered.size() && done; j++) {
+			if (is_near(buffered[i], buffered[j], eps) && !visitor.visit(buffered[i], buffered[j]))
+				done = false;
+		}
+	}
+	if (done)
+		done = self_join(top, state);
+	node_travelled = state.node_travelled;
+	unpin(slot);
+	return done;
+}
+
+
+template <int D>
+bool RTree<D>::query_point(const vector<int>& coordinate, Entry<D>& result) const
+{
+	BoundingBox<D> mbr(coordinate, coordinate);
+	int slot = pin();
+	bool found = query_point(snapshot_root(), mbr, result);
+	unpin(slot);
+	return found;
+}
+
+
+//
+// Sort ``entry_list'' along a Hilbert curve through the centers of the entry MBRs.
+//
+template <int D>
+void RTree<D>::hilbert_sort(vector<Entry<D> >& entry_list)
+{
+	ThreadPool serial(1);
+	hilbert_sort(entry_list, serial);
+}
+
+
+template <int D>
+void RTree<D>::hilbert_sort(vector<Entry<D> >& entry_list, ThreadPool& pool)
+{
+	int len = entry_list.size();
+	if (len == 0)
+		return;
+
+	vector<int> centers(len * dimension);
+	for (int i = 0; i < len; i++) {
+		const BoundingBox<D>& mbr = entry_list[i].get_mbr();
+		for (int d = 0; d < dimension; d++)
+			centers[i * dimension + d] = ((long long)mbr.get_lowestValue_at(d) + mbr.get_highestValue_at(d)) / 2;
+	}
+	// the curve is scaled to the box around the centers.
+	vector<int> lowest(centers.begin(), centers.begin() + dimension);
+	vector<int> highest(lowest);
+	for (int i = 1; i < len; i++) {
+		for (int d = 0; d < dimension; d++) {
+			lowest[d] = min(lowest[d], centers[i * dimension + d]);
+			highest[d] = max(highest[d], centers[i * dimension + d]);
+		}
+	}
+
+	vector<pair<unsigned long long, int> > keys(len);
+	vector<Entry<D> > sorted(len);
+	int chunk_cnt = pool.get_thread_num();
+	for (int c = 0; c < chunk_cnt; c++) {
+		int from = (long long)len * c / chunk_cnt, to = (long long)len * (c + 1) / chunk_cnt;
+		pool.submit([&, from, to]() {
+			for (int i = from; i < to; i++)
+				keys[i] = make_pair(hilbert_key(&centers[i * dimension], &lowest[0], &highest[0], dimension), i);
+		});
+	}
+	pool.wait();
+	parallel_sort(&keys[0], len, less<pair<unsigned long long, int> >(), pool);
+	for (int c = 0; c < chunk_cnt; c++) {
+		int from = (long long)len * c / chunk_cnt, to = (long long)len * (c + 1) / chunk_cnt;
+		pool.submit([&, from, to]() {
+			for (int i = from; i < to; i++)
+				sorted[i] = entry_list[keys[i].second];
+		});
+	}
+	pool.wait();
+	entry_list.swap(sorted);
+}
+
+
+//
+// Return the number of entries in each STR slab when ``len'' entries are cut along
+// dimension ``dim'' into slabs of whole tiles of ``node_cap'' entries.
+//
+template <int D>
+int RTree<D>::str_slab_len(int len, int dim, int node_cap)
+{
+	int node_cnt = (len + node_cap - 1) / node_cap;
+	int slab_cnt = (int)ceil(pow((double)node_cnt, 1.0 / (dimension - dim)) - EPSILON);
+	return node_cap * ((node_cnt + slab_cnt - 1) / slab_cnt);
+}
+
+
+//
+// Sort-Tile-Recursive: order ``entry_list'' so that each run of ``node_cap'' entries
+// forms a tile. The entries are cut into slabs along dimension ``dim'', and each slab
+// is tiled recursively along the next dimension.
+//
+template <int D>
+void RTree<D>::str_tile(Entry<D>* entry_list, int len, int dim, int node_cap)
+{
+	sort(entry_list, entry_list + len, CenterLess<D>(dim));
+	if (dim == dimension - 1)
+		return;
+
+	int slab_len = str_slab_len(len, dim, node_cap);
+	for (int start = 0; start < len; start += slab_len) {
+		str_tile(entry_list + start, min(slab_len, len - start), dim + 1, node_cap);
+	}
+}
+
+
+//
+// Parallel str_tile() from the first dimension: the first sort is split among the
+// threads of ``pool'', then the slabs are tiled concurrently.
+//
+template <int D>
+void RTree<D>::str_tile(Entry<D>* entry_list, int len, int node_cap, ThreadPool& pool)
+{
+	if (pool.get_thread_num() <= 1) {
+		str_tile(entry_list, len, 0, node_cap);
+		return;
+	}
+	parallel_sort(entry_list, len, CenterLess<D>(0), pool);
+	if (dimension == 1)
+		return;
+
+	int slab_len = str_slab_len(len, 0, node_cap);
+	for (int start = 0; start < len; start += slab_len) {
+		int slab = min(slab_len, len - start);
+		pool.submit([=]() { str_tile(entry_list + start, slab, 1, node_cap); });
+	}
+	pool.wait();
+}
+
+
+//
+// Pack ``entry_list'' in order into new nodes at ``level'', and replace it
+// with the entries pointing to the new nodes.
+//
+template <int D>
+void RTree<D>::pack_level(vector<Entry<D> >& entry_list, int level)
+{
+	ThreadPool serial(1);
+	pack_level(entry_list, level, serial);
+}
+
+
+template <int D>
+void RTree<D>::pack_level(vector<Entry<D> >& entry_list, int level, ThreadPool& pool)
+{
+	int len = entry_list.size();
+	vector<int> starts;
+	int start = 0;
+	while (start < len) {
+		starts.push_back(start);
+		int count = min(max_entry_num, len - start);
+		int rest = len - start - count;
+		// share the last two nodes rather than leave an almost empty one.
+		if (rest > 0 && rest < max_entry_num / 2 + 1)
+			count = (count + rest + 1) / 2;
+		start += count;
+	}
+	starts.push_back(len);
+
+	int node_cnt = starts.size() - 1;
+	vector<Entry<D> > parents(node_cnt);
+	int chunk_cnt = pool.get_thread_num();
+	for (int c = 0; c < chunk_cnt; c++) {
+		int from = (long long)node_cnt * c / chunk_cnt, to = (long long)node_cnt * (c + 1) / chunk_cnt;
+		pool.submit([&, from, to]() {
+			for (int n = from; n < to; n++) {
+				RTNode<D>* node = node_pool->alloc(level);
+				for (int i = starts[n]; i < starts[n + 1]; i++)
+					node->add_entry(entry_list[i]);
+				parents[n].set_mbr(get_mbr(node->entries, node->entry_num));
+				parents[n].set_ptr(node);
+			}
+		});
+	}
+	pool.wait();
+	entry_list.swap(parents);
+}
+
+
+//
+// Build the levels 0 .. ``height'' - 1 over ``entry_list'', whose records are already
+// in the order of ``method''. On return ``entry_list'' holds the entries pointing to the
+// nodes of level ``height'' - 1.
+//
+template <int D>
+void RTree<D>::build_subtree(vector<Entry<D> >& entry_list, int height, BulkLoadMethod method)
+{
+	for (int level = 0; level < height; level++) {
+		if (method == STR_LOAD && level > 0)
+			str_tile(&entry_list[0], entry_list.size(), 0, max_entry_num);
+		pack_level(entry_list, level);
+	}
+}
+
+
+//
+// Replace the content of the tree by ``records'', packed bottom-up into full nodes.
+// As with insert(), only the first record of each key is kept.
+// Return: the number of records loaded.
+//
+template <int D>
+int RTree<D>::bulk_load(const vector<Entry<D> >& records, BulkLoadMethod method)
+{
+	return bulk_load(records, method, 1);
+}
+
+
+//
+// bulk_load() on ``thread_num'' threads. The sorts and the tiling are split among the
+// threads, which then build independent subtrees over consecutive runs of records;
+// the levels above the subtrees are packed last.
+//
+template <int D>
+int RTree<D>::bulk_load(const vector<Entry<D> >& records, BulkLoadMethod method, int thread_num)
+{
+	free_tree(root);
+	buffered_cnt = 0;
+	tombstone_cnt = 0;
+	compact_check = 0;
+	if (records.empty()) {
+		root = node_pool->alloc(0);
+		set_locator(use_locator);
+		return 0;
+	}
+
+	ThreadPool pool(thread_num);
+	vector<Entry<D> > entry_list(records);
+	parallel_sort(&entry_list[0], entry_list.size(), CoordLess<D>(), pool);
+	entry_list.erase(unique(entry_list.begin(), entry_list.end(), SameMBR<D>()), entry_list.end());
+	int record_cnt = entry_list.size();
+
+	if (method == STR_LOAD)
+		str_tile(&entry_list[0], record_cnt, max_entry_num, pool);
+	else
+		hilbert_sort(entry_list, pool); // upper levels keep the curve order of their children
+
+	// each subtree of ``height'' levels gets max_entry_num ^ height records,
+	// with at least four subtrees per thread.
+	int height = 0;
+	long long group_len = 1;
+	while (thread_num > 1 && group_len * max_entry_num * 4 * thread_num <= record_cnt) {
+		group_len *= max_entry_num;
+		height++;
+	}
+
+	int level = 0;
+	if (height > 0) {
+		int group_cnt = (record_cnt + group_len - 1) / group_len;
+		vector<vector<Entry<D> > > groups(group_cnt);
+		for (int g = 0; g < group_cnt; g++) {
+			pool.submit([&, g]() {
+				int from = g * group_len, to = min((long long)record_cnt, (g + 1) * group_len);
+				groups[g].assign(entry_list.begin() + from, entry_list.begin() + to);
+				build_subtree(groups[g], height, method);
+			});
+		}
+		pool.wait();
+
+		entry_list.clear();
+		for (int g = 0; g < group_cnt; g++)
+			entry_list.insert(entry_list.end(), groups[g].begin(), groups[g].end());
+		level = height;
+	}
+
+	while (level == 0 || entry_list.size() > 1) {
+		if (method == STR_LOAD && level > 0)
+			str_tile(&entry_list[0], entry_list.size(), max_entry_num, pool);
+		pack_level(entry_list, level, pool);
+		level++;
+	}
+	root = entry_list[0].get_ptr();
+	set_locator(use_locator);
+
+	return record_cnt;
+}
+
+
+//
+// Count the entries and the nodes in the subtree of ``node''.
+//
+template <int D>
+void RTree<D>::count_entries(RTNode<D>* node, long long& entry_cnt, int& node_cnt)
+{
+	entry_cnt += node->entry_num;
+	node_cnt++;
+	if (node->level != 0) {
+		for (int i = 0; i < node->entry_num; i++)
+			count_entries(node->entries[i].get_ptr(), entry_cnt, node_cnt);
+	}
+}
+
+
+//
+// Return the average fraction of node capacity in use.
+//
+template <int D>
+double RTree<D>::fill_factor()
+{
+	long long entry_cnt = 0;
+	int node_cnt = 0;
+	count_entries(root, entry_cnt, node_cnt);
+	return (double)entry_cnt / ((double)node_cnt * max_entry_num);
+}
+
+
+template <int D>
+int RTree<D>::get_max_entry_num() const
+{
+	return max_entry_num;
+}
+
+
+//
+// Append the ``k'' records nearest to ``coordinate'' to ``results'', nearest first.
+//
+template <int D>
+void RTree<D>::query_knn(const vector<int>& coordinate, int k, vector<Entry<D> >& results, int& node_travelled) const
+{
+	NearestIterator<D> it(*this, coordinate);
+	Entry<D> e;
+	double dist;
+	for (int i = 0; i < k && it.next(e, dist); i++) {
+		results.push_back(e);
+	}
+	node_travelled = it.get_node_travelled();
+}
+
+
+/**********************************
+ *
+ * Please do not modify the codes below
+ *
+ **********************************/
+
+/*********************************************************
+  Return true means choose box1 for tie breaking.
+  If the two boxes is the same, return true.
+  This is to give a unified way of tie-breaking such that if your program is correct, then the result should be same, not influnced by any ties.
+ *********************************************************/
+template <int D>
+bool RTree<D>::tie_breaking(const BoundingBox<D>& box1, const BoundingBox<D>& box2)
+{
+	//for every dimension, try to break tie by the lowest value, then the highest
+	for (int i = 0; i < box1.get_dim(); i++)
+	{
+		if (box1.get_lowestValue_at(i) != box2.get_lowestValue_at(i))
+		{
+			return box1.get_lowestValue_at(i) < box2.get_lowestValue_at(i);
+		}
+		else if (box1.get_highestValue_at(i) != box2.get_highestValue_at(i))
+		{
+			return box1.get_highestValue_at(i) > box2.get_highestValue_at(i);
+		}
+	}
+	return true;
+}
+
+
+template <int D>
+void RTree<D>::stat(RTNode<D>* node, int& record_cnt, int& node_cnt)
+{
+	if (node->level == 0) {
+		record_cnt += node->entry_num;
+		node_cnt++;
+	}
+	else {
+		node_cnt++;
+		record_cnt += node->buffer.size();
+		for (int i = 0; i < node->entry_num; i++)
+			stat((node->entries[i]).get_ptr(), record_cnt, node_cnt);
+	}
+}
+
+template <int D>
+void RTree<D>::stat()
+{
+	int record_cnt = 0, node_cnt = 0;
+	stat(root, record_cnt, node_cnt);
+	cout << "Height of R-tree: " << root->level + 1 << endl;
+	cout << "Number of nodes: " << node_cnt << endl;
+	cout << "Number of records: " << record_cnt - tombstone_cnt << endl;
+	if (tombstone_cnt > 0)
+		cout << "Number of tombstones: " << tombstone_cnt << endl;
+	cout << "Dimension: " << dimension << endl;
+}
+
+
+template <int D>
+void RTree<D>::print_node(RTNode<D>* node, int indent_level)
+{
+	BoundingBox<D> mbr = get_mbr(node->entries, node->entry_num);
+
+	char* indent = new char[4*indent_level+1];
+	memset(indent, ' ', sizeof(char) * 4 * indent_level);
+	indent[4*indent_level] = '\0';
+
+	if (node->level == 0) {
+		cout << indent << "Leaf node (level = " << node->level << ") mbr: (";
+		for (int i = 0; i < mbr.get_dim(); i++)
+		{
+			cout << mbr.get_lowestValue_at(i) << " " << mbr.get_highestValue_at(i);
+			if (i != mbr.get_dim() - 1)
+			{
+				cout << " ";
+			}
+		}
+		cout << ")\n";
+	}
+	else {
+
+		cout << indent << "Non leaf node (level = " << node->level << ") mbr: (";
+		for (int i = 0; i < mbr.get_dim(); i++)
+		{
+			cout << mbr.get_lowestValue_at(i) << " " << mbr.get_highestValue_at(i);
+			if (i != mbr.get_dim() - 1)
+			{
+				cout << " ";
+			}
+		}
+		cout << ")\n";
+	}
+
+	Entry<D> *copy = new Entry<D>[node->entry_num];
+	for (int i = 0; i < node->entry_num; i++) {
+		copy[i] = node->entries[i];
+	}
+
+	for (int i = 0; i < node->entry_num; i++) {
+		int index = 0; // pick next.
+		for (int j = 1; j < node->entry_num - i; j++) {
+			if (tie_breaking(copy[j].get_mbr(), copy[index].get_mbr())) {
+				index = j;
+			}
+		}
+
+		if (node->level == 0) {
+			Entry<D>& e = copy[index];
+			cout << indent << "    Entry: <";
+			for (int i = 0; i < e.get_mbr().get_dim(); i++)
+			{
+				cout << e.get_mbr().get_lowestValue_at(i) << ", ";
+			}
+			cout << e.get_rid() << ">\n";
+		}
+		else {
+			print_node(copy[index].get_ptr(), indent_level+1);
+		}
+		// Move the output one to the rear.
+		Entry<D> tmp = copy[node->entry_num - i - 1];
+		copy[node->entry_num - i - 1] = copy[index];
+		copy[index] = tmp;
+
+	}
+
+	delete []indent;
+	delete []copy;
+}
+
+template <int D>
+void RTree<D>::print_tree()
+{
+	if (root->entry_num == 0)
+		cout << "The tree is empty now." << endl;
+	else
+		print_node(root, 0);
+}
+
+
+template class RTree<2>;
+template class RTree<3>;
+template class RTree<DYNAMIC_DIM>;
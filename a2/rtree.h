@@ -1,43 +1,257 @@
 /* Definitions of major classes */ 
+#ifndef RTREE_H
+#define RTREE_H
 
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include "epoch.h"
 #include "rtnode.h"
 
+// Receives the records found by a query, one call per record.
+// Return false from visit() to stop the query early.
+template <int D>
+class EntryVisitor {
+	public:
+		virtual ~EntryVisitor() {}
+		virtual bool visit(const Entry<D>& e) = 0;
+};
+
+// Receives the pairs of intersecting records found by a join, one call per pair.
+// Return false from visit() to stop the join early.
+template <int D>
+class EntryPairVisitor {
+	public:
+		virtual ~EntryPairVisitor() {}
+		virtual bool visit(const Entry<D>& e1, const Entry<D>& e2) = 0;
+};
+
+// How bulk_load() orders the records before packing them into nodes.
+enum BulkLoadMethod {
+	STR_LOAD,		// Sort-Tile-Recursive
+	HILBERT_LOAD	// Hilbert curve order of the MBR centers
+};
+
+// How insert() chooses subtrees and handles overflowing nodes.
+enum InsertMode {
+	GUTTMAN_INSERT,	// least area enlargement
+	RSTAR_INSERT	// R*-tree: least overlap enlargement, forced reinsertion
+};
+
+// How an overflowing node is split in two.
+enum SplitMethod {
+	LINEAR_SPLIT,		// Guttman's linear seeds, greedy assignment
+	QUADRATIC_SPLIT,	// Guttman's quadratic seeds and PickNext
+	RSTAR_SPLIT,		// R*-tree: margin-based axis, least overlap distribution
+	EXHAUSTIVE_SPLIT	// least total area over all distributions (nodes of up to 16 entries)
+};
+
+class ThreadPool;
+template <int D> class NearestIterator;
+template <int D> class NodePool;
+
+template <int D>
 class RTree {
+	friend class NearestIterator<D>;
+
 	public:
 		RTree(int entry_num);//by default, dimension is 2
 		RTree(int entry_num, int dim);
+		RTree(int entry_num, int dim, InsertMode mode);
+		RTree(int entry_num, int dim, InsertMode mode, SplitMethod split);
 		~RTree();
 
 	private:
-		bool same_entry(const Entry& e1, const Entry& e2);
-		bool overlap(const BoundingBox box1, const BoundingBox box2);
-		void update_mbr(BoundingBox& mbr, const BoundingBox& new_mbr);
-		BoundingBox get_mbr(Entry* entry_list, int len);
-		int area(const BoundingBox& mbr);
-		void swap_entry(Entry* entry_list, int id1, int id2);
-		int area_inc(const BoundingBox& mbr, const BoundingBox& entry_mbr);
-		void linear_pick_seeds(Entry* entry_list, int len, int& m1, int& m2);
-		RTNode* find_leaf(RTNode* node, RTNode** stack, int* entry_idx, int& stack_size, const Entry& record);
-		RTNode* choose_leaf(RTNode** stack, int* entry_idx, int& stack_size, const Entry& record, int dest_level);
-		void adjust_tree(RTNode** stack, int* entry_idx, int size);
-		void query_range(const RTNode* node, const BoundingBox mbr, int& result_cnt, int& node_travelled);
-		bool query_point(const RTNode* node, const BoundingBox& mbr, Entry& result);
-		bool insert(const Entry& e, int dest_level);
-		void stat(RTNode* node, int& record_cnt, int& node_cnt);
-		void print_node(RTNode* node, int indent_level);
-		void condense_tree(RTNode** stack, int* entry_idx, int size);
+		// results of a parallel query_range() gathered by one thread, padded to a cache line
+		struct alignas(64) QueryShard {
+			vector<Entry<D> > results;
+			int result_cnt;
+			int node_travelled;
+		};
+
+		// a pair of nodes, one from each tree, with their MBRs if known
+		struct JoinPair {
+			const RTNode<D>* node1;
+			const BoundingBox<D>* mbr1;
+			const RTNode<D>* node2;
+			const BoundingBox<D>* mbr2;
+		};
+
+		// state of one thread of a join()
+		struct JoinState {
+			EntryPairVisitor<D>* visitor;
+			vector<vector<pair<int, int> > > sweep;	// (lowest first coordinate, entry) of the node pairs being swept, two lists per level
+			int node_travelled;
+			vector<JoinPair>* deferred;	// node pairs left for later, or NULL to descend at once
+			atomic<bool>* stopped;	// set once the visitor returns false
+			int eps;	// records within this distance pair up, 0 for intersecting records
+		};
+
+	private:
+		bool same_entry(const Entry<D>& e1, const Entry<D>& e2);
+		bool overlap(const BoundingBox<D>& box1, const BoundingBox<D>& box2);
+		void update_mbr(BoundingBox<D>& mbr, const BoundingBox<D>& new_mbr);
+		BoundingBox<D> get_mbr(Entry<D>* entry_list, int len);
+		int area(const BoundingBox<D>& mbr);
+		void swap_entry(Entry<D>* entry_list, int id1, int id2);
+		int area_inc(const BoundingBox<D>& mbr, const BoundingBox<D>& entry_mbr);
+		void linear_pick_seeds(Entry<D>* entry_list, int len, int& m1, int& m2);
+		RTNode<D>* find_leaf(RTNode<D>* node, RTNode<D>** stack, int* entry_idx, int& stack_size, const Entry<D>& record);
+		int choose_subtree(RTNode<D>* node, const BoundingBox<D>& mbr, int dest_level);
+		RTNode<D>* choose_leaf(RTNode<D>** stack, int* entry_idx, int& stack_size, const Entry<D>& record, int dest_level,
+			bool check_dup, RTNode<D>*& dup_leaf, int& dup_idx);
+		bool find_entry(RTNode<D>* node, const BoundingBox<D>& mbr, RTNode<D>*& leaf, int& idx);
+		bool find_entry(RTNode<D>* node, const BoundingBox<D>& mbr, bool live, RTNode<D>*& leaf, int& idx);
+		RTNode<D>* find_record(RTNode<D>* node, RTNode<D>** stack, int* entry_idx, int& stack_size, const BoundingBox<D>* key, int rid, int& idx);
+		RTNode<D>* locate_record(const BoundingBox<D>* key, int rid, RTNode<D>** stack, int* entry_idx, int& stack_size, int& idx);
+		bool find_beside_path(RTNode<D>** stack, const int* entry_idx, int depth, const BoundingBox<D>& mbr, RTNode<D>*& leaf, int& idx);
+		bool find_path(RTNode<D>* node, const RTNode<D>* leaf, const BoundingBox<D>& mbr, RTNode<D>** stack, int* entry_idx, int& stack_size);
+		void locate(RTNode<D>* node);
+		void locate_all(RTNode<D>* node);
+		void remove_record(RTNode<D>* leaf, RTNode<D>** stack, int* entry_idx, int stack_size);
+		void condense_batch(RTNode<D>* node, const unordered_set<RTNode<D>*>& touched, vector<vector<Entry<D> > >& orphans);
+		void condense_touched(const unordered_set<RTNode<D>*>& touched);
+		void bury(RTNode<D>* leaf, int idx);
+		void check_compact();
+		bool revive(RTNode<D>* leaf, int idx, const Entry<D>& e);
+		void count_records(RTNode<D>* node, long long& entry_cnt);
+		int purge(RTNode<D>* node, unordered_set<RTNode<D>*>& touched);
+		void push_buffer(RTNode<D>* node, const Entry<D>& e);
+		bool flush_node(RTNode<D>* node);
+		void share_buffer(RTNode<D>* node, RTNode<D>* new_node, BoundingBox<D>& old_mbr, BoundingBox<D>& new_mbr);
+		void collect_buffers(RTNode<D>* node, vector<Entry<D> >& records);
+		bool is_private(const RTNode<D>* node) const;
+		RTNode<D>* copy_node(RTNode<D>* node);
+		RTNode<D>* own_root();
+		RTNode<D>* own_child(RTNode<D>* parent, int idx);
+		RTNode<D>* own_path(RTNode<D>** stack, int* entry_idx, int stack_size, RTNode<D>* node);
+		RTNode<D>* own_leaf(RTNode<D>* leaf, const BoundingBox<D>& mbr);
+		void free_node(RTNode<D>* node);
+		void free_tree(RTNode<D>* node);
+		bool has_tombstone(const RTNode<D>* node) const;
+		int pin() const;
+		void unpin(int slot) const;
+		const RTNode<D>* snapshot_root() const;
+		RTNode<D>* latch_root() const;
+		RTNode<D>* latch_parent(RTNode<D>* node, const vector<RTNode<D>*>& path);
+		void split_latched(RTNode<D>* node, const Entry<D>& e, const vector<RTNode<D>*>& path);
+		int least_overlap_enlargement(RTNode<D>* node, const BoundingBox<D>& mbr);
+		void linear_split(Entry<D>* entry_list, RTNode<D>* node, RTNode<D>* new_node, BoundingBox<D>& old_mbr, BoundingBox<D>& new_mbr);
+		void rstar_split(Entry<D>* entry_list, int len, RTNode<D>* node, RTNode<D>* new_node, BoundingBox<D>& old_mbr, BoundingBox<D>& new_mbr);
+		void quadratic_split(Entry<D>* entry_list, int len, RTNode<D>* node, RTNode<D>* new_node, BoundingBox<D>& old_mbr, BoundingBox<D>& new_mbr);
+		void exhaustive_split(Entry<D>* entry_list, int len, RTNode<D>* node, RTNode<D>* new_node, BoundingBox<D>& old_mbr, BoundingBox<D>& new_mbr);
+		void split_node(Entry<D>* entry_list, RTNode<D>* node, RTNode<D>* new_node, BoundingBox<D>& old_mbr, BoundingBox<D>& new_mbr);
+		void pick_reinsert(Entry<D>* entry_list, int len, RTNode<D>* node, int reinsert_num, vector<Entry<D> >& removed);
+		void grow_scratch();
+		void adjust_tree(RTNode<D>** stack, int* entry_idx, int size);
+		void query_range(const RTNode<D>* node, const BoundingBox<D>& mbr, int& result_cnt, int& node_travelled) const;
+		bool query_range(const RTNode<D>* node, const BoundingBox<D>& mbr, EntryVisitor<D>& visitor, int& node_travelled) const;
+		void query_range(const BoundingBox<D>& mbr, vector<Entry<D> >* results, int& result_count, int& node_travelled, ThreadPool& pool) const;
+		void query_subtree(const RTNode<D>* node, const BoundingBox<D>& mbr, bool collect, ThreadPool& pool, vector<QueryShard>& shards) const;
+		void query_batch(const RTNode<D>* node, const BoundingBox<D>* boxes, const int* active, int active_num, vector<vector<Entry<D> > >& results,
+			int& node_travelled, vector<vector<unsigned long long> >& masks, vector<vector<int> >& lists) const;
+		bool query_point(const RTNode<D>* node, const BoundingBox<D>& mbr, Entry<D>& result) const;
+		void sweep_list(const RTNode<D>* node, const BoundingBox<D>* mbr, vector<pair<int, int> >& list) const;
+		bool join(const RTNode<D>* node1, const BoundingBox<D>* mbr1, const RTNode<D>* node2, const BoundingBox<D>* mbr2, JoinState& state) const;
+		bool join_entry(const Entry<D>& e, const BoundingBox<D>& reach, const RTNode<D>* node, bool left, JoinState& state) const;
+		bool join_buffers(const RTNode<D>* root1, const RTree<D>& other, const RTNode<D>* root2, JoinState& state) const;
+		void gather_buffers(const RTNode<D>* node, vector<Entry<D> >& records) const;
+		bool self_join(const RTNode<D>* node, JoinState& state) const;
+		bool insert(const Entry<D>& e, int dest_level);
+		bool insert(const Entry<D>& e, int dest_level, bool replace, bool check_dup, int prefix);
+		void stat(RTNode<D>* node, int& record_cnt, int& node_cnt);
+		void print_node(RTNode<D>* node, int indent_level);
+		void condense_tree(RTNode<D>** stack, int* entry_idx, int size);
+		void count_entries(RTNode<D>* node, long long& entry_cnt, int& node_cnt);
+		void hilbert_sort(vector<Entry<D> >& entry_list);
+		void hilbert_sort(vector<Entry<D> >& entry_list, ThreadPool& pool);
+		int str_slab_len(int len, int dim, int node_cap);
+		void str_tile(Entry<D>* entry_list, int len, int dim, int node_cap);
+		void str_tile(Entry<D>* entry_list, int len, int node_cap, ThreadPool& pool);
+		void pack_level(vector<Entry<D> >& entry_list, int level);
+		void pack_level(vector<Entry<D> >& entry_list, int level, ThreadPool& pool);
+		void build_subtree(vector<Entry<D> >& entry_list, int height, BulkLoadMethod method);
 
 	public:
 		void stat();
 		void print_tree();
 		bool insert(const vector<int>& coordinate, int rid);
-		void query_range(const BoundingBox& mbr, int& result_count, int& node_travelled);
-		bool query_point(const vector<int>& coordinate, Entry& result);
-		bool tie_breaking(const BoundingBox& box1, const BoundingBox& box2);
+		bool upsert(const vector<int>& coordinate, int rid);
+		int insert_batch(const vector<Entry<D> >& records);
+		// the queries only read the tree: any number of them may run at once between updates.
+		void query_range(const BoundingBox<D>& mbr, int& result_count, int& node_travelled) const;
+		void query_range(const BoundingBox<D>& mbr, vector<Entry<D> >& results, int& node_travelled) const;
+		bool query_range(const BoundingBox<D>& mbr, EntryVisitor<D>& visitor, int& node_travelled) const;
+		// parallel forms: large ranges are searched by the threads of ``pool'', one query at a time per pool.
+		void query_range(const BoundingBox<D>& mbr, int& result_count, int& node_travelled, ThreadPool& pool) const;
+		void query_range(const BoundingBox<D>& mbr, vector<Entry<D> >& results, int& node_travelled, ThreadPool& pool) const;
+		// ``results[i]'' gets the records inside ``boxes[i]'', found in one traversal for the whole batch.
+		void query_range_batch(const vector<BoundingBox<D> >& boxes, vector<vector<Entry<D> > >& results, int& node_travelled) const;
+		void query_range_batch(const vector<BoundingBox<D> >& boxes, vector<vector<Entry<D> > >& results, int& node_travelled, ThreadPool& pool) const;
+		bool query_point(const vector<int>& coordinate, Entry<D>& result) const;
+		// pairs of intersecting records, the first from this tree and the second from ``other''.
+		bool join(const RTree<D>& other, EntryPairVisitor<D>& visitor, int& node_travelled) const;
+		bool join(const RTree<D>& other, EntryPairVisitor<D>& visitor, int& node_travelled, ThreadPool& pool) const;
+		// each pair of records within distance ``eps'' of each other, once.
+		bool self_join(int eps, EntryPairVisitor<D>& visitor, int& node_travelled) const;
+		// latched insertion: any number of threads may run these at once, and nothing else.
+		bool insert_latched(const vector<int>& coordinate, int rid);
+		void query_range_latched(const BoundingBox<D>& mbr, int& result_count, int& node_travelled) const;
+		void query_knn(const vector<int>& coordinate, int k, vector<Entry<D> >& results, int& node_travelled) const;
+		bool tie_breaking(const BoundingBox<D>& box1, const BoundingBox<D>& box2);
 		bool del(const vector<int>& coordinate);
+		bool del(const vector<int>& coordinate, int rid);
+		bool del_rid(int rid);
+		int delete_batch(const vector<vector<int> >& keys);
+		bool update(int rid, const vector<int>& old_coord, const vector<int>& new_coord);
+		bool update(int rid, const vector<int>& old_coord, const vector<int>& new_coord, int tolerance);
+		void set_locator(bool enabled);
+		void set_buffer_size(int size);
+		void flush();
+		void set_lazy_delete(bool enabled, double ratio);
+		int compact();
+		void set_snapshots(bool enabled);
+		void publish();
+		int bulk_load(const vector<Entry<D> >& records, BulkLoadMethod method);
+		int bulk_load(const vector<Entry<D> >& records, BulkLoadMethod method, int thread_num);
+		double fill_factor();
+		int get_max_entry_num() const;
 
 	private:
 		int max_entry_num;
 		int dimension;
-		RTNode* root;
+		RTNode<D>* root;
+		NodePool<D>* node_pool;	// owns every node of the tree
+		bool use_locator;
+		unordered_map<int, RTNode<D>*> locator;	// rid -> leaf holding the record, if use_locator
+		int buffer_size;	// records per node buffer, 0 if insertion is not buffered
+		long long buffered_cnt;	// records waiting in node buffers
+		bool lazy_delete;	// del() leaves tombstones
+		double compact_ratio;	// tombstones per leaf entry that trigger compact(), 0 for never
+		long long tombstone_cnt;
+		long long compact_check;	// leaf entries at the last ratio check
+		InsertMode insert_mode;
+		SplitMethod split_method;
+		vector<bool> reinserted; // R*: levels that already had a forced reinsertion in this insert
+		// scratch buffers of insert() and del(), grown with the height of the tree
+		vector<RTNode<D>*> path_stack;
+		vector<int> path_idx;
+		vector<RTNode<D>*> condensed;	// nodes removed by condense_tree()
+		vector<Entry<D> > split_buffer;	// entries of an overflowing node and the new one
+		vector<vector<Entry<D> > > reinsert_buffer;	// R*: entries taken out, per level
+		vector<pair<double, int> > reinsert_order;
+		vector<vector<Entry<D> > > flush_buffer;	// records being pushed down, per level
+		vector<RTNode<D>*> copy_stack;	// own_leaf(): path to the leaf
+		vector<int> copy_idx;
+		bool snapshots;	// updates copy the nodes they modify, see set_snapshots()
+		atomic<RTNode<D>*> published;	// root seen by the queries in snapshot mode
+		mutable EpochManager epochs;
+		vector<RTNode<D>*> replaced;	// nodes taken out of the tree since the last publish()
+		vector<RTNode<D>*> limbo[3];	// replaced nodes waiting for their readers, by epoch % 3
+		atomic<unsigned long long> split_cnt;	// latched insertion: node sequence numbers handed out
+		mutable mutex root_lock;	// latched insertion: guards root and level_head
+		vector<RTNode<D>*> level_head;	// latched insertion: first node of each level grown by a root split
 };
+
+#endif
@@ -0,0 +1,535 @@
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include "sharded.h"
+
+// the largest shard may hold this many times the mean number of records before a rebalance.
+const double SHARD_SKEW = 2.0;
+// updates between two balance checks, and records per shard below which skew is ignored.
+const int BALANCE_CHECK_INTERVAL = 4096;
+const int MIN_BALANCE_SIZE = 1024;
+// records per shard in the sample the partition is computed from.
+const int SHARD_SAMPLE_SIZE = 1024;
+
+//
+// Whether ``mbr'' is a single point. A record goes to the shard whose region holds its key,
+// and the queries pass over the shards by region, so a shard holds points only.
+//
+template <int D>
+static bool is_point(const BoundingBox<D>& mbr)
+{
+	for (int i = 0; i < mbr.get_dim(); i++) {
+		if (mbr.get_lowestValue_at(i) != mbr.get_highestValue_at(i))
+			return false;
+	}
+	return true;
+}
+
+//======================== ShardedRTree implementation =============================================
+
+//
+// The shards start on an even split of the whole coordinate range, and get a partition
+// fitting the data at the first bulk_load() or rebalance.
+//
+template <int D>
+ShardedRTree<D>::ShardedRTree(int entry_num, int dim, int shard_num)
+{
+	dimension = D != DYNAMIC_DIM ? D : dim;
+	update_cnt.store(0);
+	if (shard_num < 1)
+		shard_num = 1;
+	vector<int> low(dimension, INT_MIN), high(dimension, INT_MAX);
+	vector<BoundingBox<D> > regions;
+	split_region(NULL, 0, shard_num, BoundingBox<D>(low, high), regions);
+	for (int i = 0; i < shard_num; i++) {
+		Shard* shard = new Shard();
+		shard->tree = new RTree<D>(entry_num, dimension);
+		shard->region = regions[i];
+		shard->size.store(0);
+		shard->stopping = false;
+		shard->worker = thread(&ShardedRTree::work, this, shard);
+		shards.push_back(shard);
+	}
+}
+
+template <int D>
+ShardedRTree<D>::~ShardedRTree()
+{
+	for (size_t i = 0; i < shards.size(); i++) {
+		{
+			lock_guard<mutex> guard(shards[i]->lock);
+			shards[i]->stopping = true;
+		}
+		shards[i]->task_ready.notify_one();
+		shards[i]->worker.join();
+		delete shards[i]->tree;
+		delete shards[i];
+	}
+}
+
+//
+// Queue ``task'' on the worker of ``shard''. The future is ready once the task has run.
+//
+template <int D>
+future<void> ShardedRTree<D>::post(Shard* shard, const function<void()>& task) const
+{
+	shared_ptr<promise<void> > done(new promise<void>());
+	future<void> result = done->get_future();
+	{
+		lock_guard<mutex> guard(shard->lock);
+		shard->tasks.push_back([task, done]() { task(); done->set_value(); });
+	}
+	shard->task_ready.notify_one();
+	return result;
+}
+
+//
+// Worker loop of ``shard'': run its tasks in order until the tree is destroyed.
+//
+template <int D>
+void ShardedRTree<D>::work(Shard* shard)
+{
+	unique_lock<mutex> guard(shard->lock);
+	while (true) {
+		while (shard->tasks.empty() && !shard->stopping)
+			shard->task_ready.wait(guard);
+		if (shard->tasks.empty())
+			return;
+
+		function<void()> task = shard->tasks.front();
+		shard->tasks.pop_front();
+		guard.unlock();
+		task();
+		guard.lock();
+	}
+}
+
+//
+// Return: the shard whose region holds ``point''.
+//
+template <int D>
+int ShardedRTree<D>::route(const int* point) const
+{
+	for (size_t i = 0; i + 1 < shards.size(); i++) {
+		const BoundingBox<D>& region = shards[i]->region;
+		int d = 0;
+		while (d < dimension && point[d] >= region.get_lowestValue_at(d) && point[d] <= region.get_highestValue_at(d))
+			d++;
+		if (d == dimension)
+			return i;
+	}
+	return shards.size() - 1;
+}
+
+//
+// Cut ``cell'' into ``shard_num'' regions appended to ``regions''. Each cut is across the
+// dimension where the ``len'' records of ``sample'' spread most, at the record that leaves
+// both sides a share of the sample proportional to their number of shards. Without a sample
+// the widest dimension of the cell is cut in half.
+//
+template <int D>
+void ShardedRTree<D>::split_region(Entry<D>* sample, int len, int shard_num, const BoundingBox<D>& cell, vector<BoundingBox<D> >& regions)
+{
+	if (shard_num == 1) {
+		regions.push_back(cell);
+		return;
+	}
+	int left = shard_num / 2;
+	int dim = -1;
+	long long cut = 0;
+	if (len >= 2) {
+		long long spread = 0;
+		for (int d = 0; d < dimension; d++) {
+			int lowest = INT_MAX, highest = INT_MIN;
+			for (int i = 0; i < len; i++) {
+				lowest = min(lowest, sample[i].get_mbr().get_lowestValue_at(d));
+				highest = max(highest, sample[i].get_mbr().get_lowestValue_at(d));
+			}
+			if ((long long)highest - lowest > spread) {
+				spread = (long long)highest - lowest;
+				dim = d;
+			}
+		}
+		if (dim >= 0) {
+			int mid = (long long)len * left / shard_num;
+			nth_element(sample, sample + mid, sample + len, [dim](const Entry<D>& e1, const Entry<D>& e2) {
+				return e1.get_mbr().get_lowestValue_at(dim) < e2.get_mbr().get_lowestValue_at(dim);
+			});
+			cut = sample[mid].get_mbr().get_lowestValue_at(dim);
+		}
+	}
+	if (dim < 0) {
+		long long width = -1;
+		for (int d = 0; d < dimension; d++) {
+			if ((long long)cell.get_highestValue_at(d) - cell.get_lowestValue_at(d) > width) {
+				width = (long long)cell.get_highestValue_at(d) - cell.get_lowestValue_at(d);
+				dim = d;
+			}
+		}
+		cut = cell.get_lowestValue_at(dim) + (width + 1) / 2;
+	}
+	// both sides keep at least one coordinate.
+	cut = max(cut, (long long)cell.get_lowestValue_at(dim) + 1);
+	cut = min(cut, (long long)cell.get_highestValue_at(dim));
+
+	vector<int> low(cell.get_lowest(), cell.get_lowest() + dimension);
+	vector<int> high(cell.get_highest(), cell.get_highest() + dimension);
+	high[dim] = cut - 1;
+	BoundingBox<D> left_cell(low, high);
+	high[dim] = cell.get_highestValue_at(dim);
+	low[dim] = cut;
+	BoundingBox<D> right_cell(low, high);
+	Entry<D>* middle = partition(sample, sample + len, [dim, cut](const Entry<D>& e) {
+		return e.get_mbr().get_lowestValue_at(dim) < cut;
+	});
+	split_region(sample, middle - sample, left, left_cell, regions);
+	split_region(middle, sample + len - middle, shard_num - left, right_cell, regions);
+}
+
+//
+// Partition the space on a sample of ``records'' and load each shard with its records.
+// The caller holds ``layout'' exclusively.
+//
+template <int D>
+void ShardedRTree<D>::load_shards(const vector<Entry<D> >& records, BulkLoadMethod method)
+{
+	int shard_num = shards.size();
+	long long len = records.size();
+	long long sample_len = min(len, (long long)SHARD_SAMPLE_SIZE * shard_num);
+	vector<Entry<D> > sample;
+	sample.reserve(sample_len);
+	for (long long i = 0; i < sample_len; i++)
+		sample.push_back(records[len * i / sample_len]);
+	vector<int> low(dimension, INT_MIN), high(dimension, INT_MAX);
+	vector<BoundingBox<D> > regions;
+	split_region(sample.empty() ? NULL : &sample[0], sample.size(), shard_num, BoundingBox<D>(low, high), regions);
+	for (int i = 0; i < shard_num; i++)
+		shards[i]->region = regions[i];
+
+	vector<vector<Entry<D> > > parts(shard_num);
+	for (long long i = 0; i < len; i++)
+		parts[route(records[i].get_mbr().get_lowest())].push_back(records[i]);
+	vector<future<void> > done;
+	for (int i = 0; i < shard_num; i++) {
+		Shard* shard = shards[i];
+		done.push_back(post(shard, [shard, &parts, i, method]() {
+			shard->size.store(shard->tree->bulk_load(parts[i], method));
+		}));
+	}
+	for (int i = 0; i < shard_num; i++)
+		done[i].wait();
+}
+
+//
+// Return true if the largest shard holds more than SHARD_SKEW times the mean.
+//
+template <int D>
+bool ShardedRTree<D>::is_skewed() const
+{
+	long long total = 0, largest = 0;
+	for (size_t i = 0; i < shards.size(); i++) {
+		long long size = shards[i]->size.load();
+		total += size;
+		largest = max(largest, size);
+	}
+	return total >= (long long)MIN_BALANCE_SIZE * shards.size() && largest > SHARD_SKEW * total / shards.size();
+}
+
+template <int D>
+void ShardedRTree<D>::check_balance()
+{
+	if (!is_skewed())
+		return;
+	unique_lock<shared_mutex> guard(layout);
+	// another thread may have rebalanced meanwhile.
+	if (is_skewed())
+		rebuild();
+}
+
+template <int D>
+void ShardedRTree<D>::rebalance()
+{
+	unique_lock<shared_mutex> guard(layout);
+	rebuild();
+}
+
+//
+// Gather the records of every shard, partition the space again and reload the shards.
+// The caller holds ``layout'' exclusively.
+//
+template <int D>
+void ShardedRTree<D>::rebuild()
+{
+	int shard_num = shards.size();
+	vector<int> low(dimension, INT_MIN), high(dimension, INT_MAX);
+	BoundingBox<D> domain(low, high);
+	vector<vector<Entry<D> > > parts(shard_num);
+	vector<future<void> > done;
+	for (int i = 0; i < shard_num; i++) {
+		Shard* shard = shards[i];
+		done.push_back(post(shard, [shard, &parts, &domain, i]() {
+			int node_travelled;
+			shard->tree->query_range(domain, parts[i], node_travelled);
+		}));
+	}
+	vector<Entry<D> > records;
+	for (int i = 0; i < shard_num; i++) {
+		done[i].wait();
+		records.insert(records.end(), parts[i].begin(), parts[i].end());
+		vector<Entry<D> >().swap(parts[i]);
+	}
+	load_shards(records, STR_LOAD);
+	update_cnt.store(0);
+}
+
+template <int D>
+void ShardedRTree<D>::query_range(const BoundingBox<D>& mbr, int& result_count, int& node_travelled) const
+{
+	shared_lock<shared_mutex> guard(layout);
+	vector<int> counts(2 * shards.size(), 0);
+	vector<future<void> > done;
+	for (size_t i = 0; i < shards.size(); i++) {
+		Shard* shard = shards[i];
+		if (!shard->region.is_intersected(mbr))
+			continue;
+		done.push_back(post(shard, [shard, &mbr, &counts, i]() {
+			shard->tree->query_range(mbr, counts[2 * i], counts[2 * i + 1]);
+		}));
+	}
+	for (size_t i = 0; i < done.size(); i++)
+		done[i].wait();
+	result_count = 0;
+	node_travelled = 0;
+	for (size_t i = 0; i < shards.size(); i++) {
+		result_count += counts[2 * i];
+		node_travelled += counts[2 * i + 1];
+	}
+}
+
+//
+// Append the records inside ``mbr'' to ``results'', grouped by shard.
+//
+template <int D>
+void ShardedRTree<D>::query_range(const BoundingBox<D>& mbr, vector<Entry<D> >& results, int& node_travelled) const
+{
+	shared_lock<shared_mutex> guard(layout);
+	vector<vector<Entry<D> > > parts(shards.size());
+	vector<int> travelled(shards.size(), 0);
+	vector<future<void> > done;
+	for (size_t i = 0; i < shards.size(); i++) {
+		Shard* shard = shards[i];
+		if (!shard->region.is_intersected(mbr))
+			continue;
+		done.push_back(post(shard, [shard, &mbr, &parts, &travelled, i]() {
+			shard->tree->query_range(mbr, parts[i], travelled[i]);
+		}));
+	}
+	for (size_t i = 0; i < done.size(); i++)
+		done[i].wait();
+	node_travelled = 0;
+	for (size_t i = 0; i < shards.size(); i++) {
+		results.insert(results.end(), parts[i].begin(), parts[i].end());
+		node_travelled += travelled[i];
+	}
+}
+
+template <int D>
+bool ShardedRTree<D>::query_point(const vector<int>& coordinate, Entry<D>& result) const
+{
+	shared_lock<shared_mutex> guard(layout);
+	Shard* shard = shards[route(&coordinate[0])];
+	bool found = false;
+	post(shard, [&]() { found = shard->tree->query_point(coordinate, result); }).wait();
+	return found;
+}
+
+//
+// The shard holding ``coordinate'' answers first. Only the shards whose region is nearer
+// than its k-th nearest record are asked next, and the k nearest of all answers are kept.
+//
+template <int D>
+void ShardedRTree<D>::query_knn(const vector<int>& coordinate, int k, vector<Entry<D> >& results, int& node_travelled) const
+{
+	shared_lock<shared_mutex> guard(layout);
+	int home = route(&coordinate[0]);
+	vector<vector<Entry<D> > > parts(shards.size());
+	vector<int> travelled(shards.size(), 0);
+	Shard* shard = shards[home];
+	post(shard, [&]() { shard->tree->query_knn(coordinate, k, parts[home], travelled[home]); }).wait();
+	double bound = (int)parts[home].size() < k ? HUGE_VAL : parts[home].back().get_mbr().get_mindist(&coordinate[0]);
+
+	vector<future<void> > done;
+	for (size_t i = 0; i < shards.size(); i++) {
+		Shard* other = shards[i];
+		if ((int)i == home || other->region.get_mindist(&coordinate[0]) > bound)
+			continue;
+		done.push_back(post(other, [other, &coordinate, k, &parts, &travelled, i]() {
+			other->tree->query_knn(coordinate, k, parts[i], travelled[i]);
+		}));
+	}
+	for (size_t i = 0; i < done.size(); i++)
+		done[i].wait();
+
+	vector<pair<double, const Entry<D>*> > candidates;
+	node_travelled = 0;
+	for (size_t i = 0; i < shards.size(); i++) {
+		for (size_t j = 0; j < parts[i].size(); j++)
+			candidates.push_back(make_pair(parts[i][j].get_mbr().get_mindist(&coordinate[0]), &parts[i][j]));
+		node_travelled += travelled[i];
+	}
+	int found = min(k, (int)candidates.size());
+	partial_sort(candidates.begin(), candidates.begin() + found, candidates.end(),
+		[](const pair<double, const Entry<D>*>& c1, const pair<double, const Entry<D>*>& c2) { return c1.first < c2.first; });
+	for (int i = 0; i < found; i++)
+		results.push_back(*candidates[i].second);
+}
+
+template <int D>
+bool ShardedRTree<D>::insert(const vector<int>& coordinate, int rid)
+{
+	bool inserted = false;
+	{
+		shared_lock<shared_mutex> guard(layout);
+		Shard* shard = shards[route(&coordinate[0])];
+		post(shard, [&]() {
+			inserted = shard->tree->insert(coordinate, rid);
+			if (inserted)
+				shard->size++;
+		}).wait();
+	}
+	if (++update_cnt % BALANCE_CHECK_INTERVAL == 0)
+		check_balance();
+	return inserted;
+}
+
+//
+// Insert ``records'' with one insert_batch() per shard, the shards working at once.
+//
+template <int D>
+int ShardedRTree<D>::insert_batch(const vector<Entry<D> >& records)
+{
+	int inserted = 0;
+	{
+		shared_lock<shared_mutex> guard(layout);
+		vector<vector<Entry<D> > > parts(shards.size());
+		for (size_t i = 0; i < records.size(); i++) {
+			if (is_point(records[i].get_mbr()))
+				parts[route(records[i].get_mbr().get_lowest())].push_back(records[i]);
+			else
+				cerr << "Sharded R-tree record " << records[i].get_rid() << " is not a point\n";
+		}
+		vector<int> counts(shards.size(), 0);
+		vector<future<void> > done;
+		for (size_t i = 0; i < shards.size(); i++) {
+			Shard* shard = shards[i];
+			if (parts[i].empty())
+				continue;
+			done.push_back(post(shard, [shard, &parts, &counts, i]() {
+				counts[i] = shard->tree->insert_batch(parts[i]);
+				shard->size += counts[i];
+			}));
+		}
+		for (size_t i = 0; i < done.size(); i++)
+			done[i].wait();
+		for (size_t i = 0; i < shards.size(); i++)
+			inserted += counts[i];
+	}
+	update_cnt += records.size();
+	check_balance();
+	return inserted;
+}
+
+template <int D>
+bool ShardedRTree<D>::del(const vector<int>& coordinate)
+{
+	bool deleted = false;
+	{
+		shared_lock<shared_mutex> guard(layout);
+		Shard* shard = shards[route(&coordinate[0])];
+		post(shard, [&]() {
+			deleted = shard->tree->del(coordinate);
+			if (deleted)
+				shard->size--;
+		}).wait();
+	}
+	if (++update_cnt % BALANCE_CHECK_INTERVAL == 0)
+		check_balance();
+	return deleted;
+}
+
+template <int D>
+bool ShardedRTree<D>::del(const vector<int>& coordinate, int rid)
+{
+	bool deleted = false;
+	{
+		shared_lock<shared_mutex> guard(layout);
+		Shard* shard = shards[route(&coordinate[0])];
+		post(shard, [&]() {
+			deleted = shard->tree->del(coordinate, rid);
+			if (deleted)
+				shard->size--;
+		}).wait();
+	}
+	if (++update_cnt % BALANCE_CHECK_INTERVAL == 0)
+		check_balance();
+	return deleted;
+}
+
+//
+// Replace the records by the point records of ``records'', on a partition computed from them.
+// Return: the number of records loaded.
+//
+template <int D>
+int ShardedRTree<D>::bulk_load(const vector<Entry<D> >& records, BulkLoadMethod method)
+{
+	// the records are copied only once one is not a point.
+	size_t len = 0;
+	while (len < records.size() && is_point(records[len].get_mbr()))
+		len++;
+	vector<Entry<D> > points;
+	if (len < records.size()) {
+		points.assign(records.begin(), records.begin() + len);
+		for (size_t i = len; i < records.size(); i++) {
+			if (is_point(records[i].get_mbr()))
+				points.push_back(records[i]);
+			else
+				cerr << "Sharded R-tree record " << records[i].get_rid() << " is not a point\n";
+		}
+	}
+	unique_lock<shared_mutex> guard(layout);
+	load_shards(len < records.size() ? points : records, method);
+	update_cnt.store(0);
+	return get_size();
+}
+
+template <int D>
+int ShardedRTree<D>::get_shard_num() const
+{
+	return shards.size();
+}
+
+template <int D>
+long long ShardedRTree<D>::get_size() const
+{
+	long long total = 0;
+	for (size_t i = 0; i < shards.size(); i++)
+		total += shards[i]->size.load();
+	return total;
+}
+
+template <int D>
+void ShardedRTree<D>::stat() const
+{
+	shared_lock<shared_mutex> guard(layout);
+	cout << "Number of shards: " << shards.size() << endl;
+	cout << "Number of records: " << get_size() << endl;
+	for (size_t i = 0; i < shards.size(); i++) {
+		cout << "Shard " << i << ": " << shards[i]->size.load() << " records, region ";
+		shards[i]->region.print();
+	}
+}
+
+
+template class ShardedRTree<2>;
+template class ShardedRTree<3>;
+template class ShardedRTree<DYNAMIC_DIM>;
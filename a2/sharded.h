@@ -0,0 +1,75 @@
+#ifndef SHARDED_H
+#define SHARDED_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include "rtree.h"
+
+//
+// Point records split among RTrees by a KD partition of the space, one tree per shard.
+// A shard is only ever touched by its own worker thread: an update goes to the shard whose
+// region holds its coordinate, and a query goes to the shards whose regions it reaches, which
+// search at once while the caller gathers their results. When the largest shard outgrows the
+// mean size too far, the shards are rebuilt on a partition computed from a sample of the records.
+// Any number of threads may call the methods at once. insert_batch() and bulk_load() leave
+// out the records that are not points, which could reach past the region of their shard.
+//
+template <int D>
+class ShardedRTree {
+	public:
+		ShardedRTree(int entry_num, int dim, int shard_num);
+		~ShardedRTree();
+
+		// readers
+		void query_range(const BoundingBox<D>& mbr, int& result_count, int& node_travelled) const;
+		void query_range(const BoundingBox<D>& mbr, vector<Entry<D> >& results, int& node_travelled) const;
+		bool query_point(const vector<int>& coordinate, Entry<D>& result) const;
+		void query_knn(const vector<int>& coordinate, int k, vector<Entry<D> >& results, int& node_travelled) const;
+
+		// writers
+		bool insert(const vector<int>& coordinate, int rid);
+		int insert_batch(const vector<Entry<D> >& records);
+		bool del(const vector<int>& coordinate);
+		bool del(const vector<int>& coordinate, int rid);
+		int bulk_load(const vector<Entry<D> >& records, BulkLoadMethod method);
+		void rebalance();
+
+		int get_shard_num() const;
+		long long get_size() const;
+		void stat() const;
+
+	private:
+		struct Shard {
+			RTree<D>* tree;
+			BoundingBox<D> region;	// the coordinates routed to this shard
+			atomic<long long> size;
+			thread worker;
+			deque<function<void()> > tasks;
+			mutex lock;
+			condition_variable task_ready;
+			bool stopping;
+		};
+
+		future<void> post(Shard* shard, const function<void()>& task) const;
+		void work(Shard* shard);
+		int route(const int* point) const;
+		void split_region(Entry<D>* sample, int len, int shard_num, const BoundingBox<D>& cell, vector<BoundingBox<D> >& regions);
+		void load_shards(const vector<Entry<D> >& records, BulkLoadMethod method);
+		bool is_skewed() const;
+		void check_balance();
+		void rebuild();
+
+	private:
+		int dimension;
+		vector<Shard*> shards;
+		mutable shared_mutex layout;	// held exclusively while the shards are rebuilt
+		atomic<long long> update_cnt;	// updates since the last balance check
+};
+
+#endif
@@ -0,0 +1,125 @@
+#include "threadpool.h"
+
+// pool and deque index of the worker running on this thread
+static thread_local const ThreadPool* current_pool = NULL;
+static thread_local int current_index = -1;
+
+//======================== ThreadPool implementation ===============================================
+
+ThreadPool::ThreadPool(int thread_num)
+{
+	pending = 0;
+	queued = 0;
+	next_queue = 0;
+	stopping = false;
+	if (thread_num > 1) {
+		for (int i = 0; i < thread_num; i++)
+			queues.push_back(unique_ptr<TaskQueue>(new TaskQueue()));
+		for (int i = 0; i < thread_num; i++)
+			workers.push_back(thread(&ThreadPool::work, this, i));
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		unique_lock<mutex> guard(lock);
+		stopping = true;
+	}
+	task_ready.notify_all();
+	for (size_t i = 0; i < workers.size(); i++)
+		workers[i].join();
+}
+
+void ThreadPool::submit(const function<void()>& task)
+{
+	if (workers.empty()) {
+		task();
+		return;
+	}
+	int index = get_worker_index();
+	{
+		unique_lock<mutex> guard(lock);
+		pending++;
+		if (index < 0)
+			index = next_queue++ % queues.size();
+	}
+	{
+		unique_lock<mutex> guard(queues[index]->lock);
+		queues[index]->tasks.push_back(task);
+	}
+	{
+		unique_lock<mutex> guard(lock);
+		queued++;
+	}
+	task_ready.notify_one();
+}
+
+void ThreadPool::wait()
+{
+	unique_lock<mutex> guard(lock);
+	while (pending > 0)
+		all_done.wait(guard);
+}
+
+int ThreadPool::get_thread_num() const
+{
+	return workers.empty() ? 1 : workers.size();
+}
+
+int ThreadPool::get_worker_index() const
+{
+	return current_pool == this ? current_index : -1;
+}
+
+//
+// Pop the newest task of deque ``index'', or else steal the oldest one of another deque.
+//
+bool ThreadPool::take(int index, function<void()>& task)
+{
+	for (size_t i = 0; i < queues.size(); i++) {
+		TaskQueue& q = *queues[(index + i) % queues.size()];
+		unique_lock<mutex> guard(q.lock);
+		if (q.tasks.empty())
+			continue;
+		if (i == 0) {
+			task = q.tasks.back();
+			q.tasks.pop_back();
+		} else {
+			task = q.tasks.front();
+			q.tasks.pop_front();
+		}
+		return true;
+	}
+	return false;
+}
+
+//
+// Worker loop: run tasks until the pool is destroyed.
+// ``queued'' may fall below zero for a moment, when a task is taken before submit() counts it.
+//
+void ThreadPool::work(int index)
+{
+	current_pool = this;
+	current_index = index;
+	function<void()> task;
+	while (true) {
+		if (take(index, task)) {
+			{
+				unique_lock<mutex> guard(lock);
+				queued--;
+			}
+			task();
+			task = nullptr;
+			unique_lock<mutex> guard(lock);
+			if (--pending == 0)
+				all_done.notify_all();
+			continue;
+		}
+		unique_lock<mutex> guard(lock);
+		while (queued <= 0 && !stopping)
+			task_ready.wait(guard);
+		if (queued <= 0)
+			return;
+	}
+}
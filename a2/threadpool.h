@@ -0,0 +1,51 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+//
+// Fixed set of worker threads with a task deque each. A task submitted by a worker goes
+// on its own deque, which it runs newest first; other tasks are dealt to the deques in turn.
+// An idle worker steals the oldest task of another deque.
+// A pool of one thread or less runs each task inline in submit().
+//
+class ThreadPool {
+	public:
+		ThreadPool(int thread_num);
+		~ThreadPool();
+
+		void submit(const function<void()>& task);
+		void wait(); // block until every submitted task has finished
+		int get_thread_num() const;
+		int get_worker_index() const; // index of the calling worker, -1 for other threads
+
+	private:
+		struct TaskQueue {
+			deque<function<void()> > tasks;
+			mutex lock;
+		};
+
+		void work(int index);
+		bool take(int index, function<void()>& task);
+
+	private:
+		vector<thread> workers;
+		vector<unique_ptr<TaskQueue> > queues;
+		mutex lock;
+		condition_variable task_ready;
+		condition_variable all_done;
+		int pending;	// tasks submitted and not finished yet
+		int queued;	// tasks waiting in the deques
+		unsigned next_queue;	// deque for the next task from outside the pool
+		bool stopping;
+};
+
+#endif